@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <limits>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/** Alignment (in bytes) of image buffers and padded rows: one cache line, also enough for AVX-512 loads. */
+constexpr std::size_t IMAGE_ALIGNMENT = 64;
+
+/**
+ * Minimal std::allocator replacement returning memory aligned to Alignment bytes.
+ * Used as the allocator of Image<T>::data so the first row always starts on a cache line.
+ */
+template <typename T, std::size_t Alignment = IMAGE_ALIGNMENT>
+struct AlignedAllocator {
+    static_assert(Alignment >= alignof(T), "Alignment must not be weaker than the natural alignment of T.");
+    static_assert((Alignment & (Alignment - 1)) == 0, "Alignment must be a power of two.");
+
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = AlignedAllocator<U, Alignment>;
+    };
+
+    AlignedAllocator() noexcept = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept { }
+
+    T* allocate(std::size_t n)
+    {
+        if (n > std::numeric_limits<std::size_t>::max() / sizeof(T))
+            throw std::bad_array_new_length();
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+    }
+
+    void deallocate(T* p, std::size_t) noexcept
+    {
+        ::operator delete(p, std::align_val_t(Alignment));
+    }
+
+    /**
+     * Default-initializes instead of value-initializing, so vector::resize(n) leaves trivial pixels
+     * uninitialized. Use resize(n, T {}) where zeros are required.
+     */
+    template <typename U>
+    void construct(U* p) noexcept(std::is_nothrow_default_constructible_v<U>)
+    {
+        ::new (static_cast<void*>(p)) U;
+    }
+
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args)
+    {
+        ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment>&) const noexcept { return false; }
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+/*
+ * Runtime detection of the x86 SIMD extensions used by hand-vectorized kernels.
+ * Kernels are compiled for these targets with function attributes (see SIMD_TARGET_AVX2 / SIMD_TARGET_AVX512)
+ * and only called when the running CPU supports them, so the rest of the build keeps its default target.
+ * On other architectures every query returns false.
+ */
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SIMD_X86 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#include <immintrin.h>
+// MSVC compiles intrinsics for any target without attributes.
+#define SIMD_TARGET_AVX2
+#define SIMD_TARGET_AVX512
+#else
+#include <immintrin.h>
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define SIMD_TARGET_AVX512 __attribute__((target("avx512f,avx2,fma")))
+#endif
+#else
+#define SIMD_X86 0
+#endif
+
+inline bool cpuSupportsAvx2()
+{
+#if SIMD_X86
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    const bool os_saves_ymm = (info[2] & (1 << 27)) && (_xgetbv(0) & 0x6) == 0x6;
+    const bool fma = info[2] & (1 << 12);
+    __cpuidex(info, 7, 0);
+    return os_saves_ymm && fma && (info[1] & (1 << 5));
+#else
+    static const bool supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    return supported;
+#endif
+#else
+    return false;
+#endif
+}
+
+inline bool cpuSupportsAvx512()
+{
+#if SIMD_X86
+#if defined(_MSC_VER) && !defined(__clang__)
+    if (!cpuSupportsAvx2())
+        return false;
+    int info[4];
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 16)) && (_xgetbv(0) & 0xe6) == 0xe6;
+#else
+    static const bool supported = cpuSupportsAvx2() && __builtin_cpu_supports("avx512f");
+    return supported;
+#endif
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,405 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <numbers>
+#include <vector>
+
+#include "image.h"
+
+/*
+ * In-tree FFTs for image convolution.
+ *
+ * FFT: iterative radix-2 complex transform of a power-of-two size.
+ * RealFFT: real-to-complex transform of a power-of-two size n, computed with a complex FFT of size n / 2;
+ *          the spectrum holds the n / 2 + 1 non-redundant bins.
+ * RealFFT2D: row-major 2D real-to-complex transform, (width / 2 + 1) x height bins, rows and columns in parallel.
+ * FFTConvolver: zero-padded linear convolution of images with a fixed kernel, whose spectrum is computed once.
+ * BluesteinFFT: complex transform of any size n (chirp-z: a convolution computed with FFTs of a power of two >= 2n - 1).
+ * DST / DST2D: type-I discrete sine transform of any size, two real sequences per complex transform; the 2D version
+ *              transforms rows, then columns, in parallel.
+ *
+ * Forward transforms are unnormalized, inverse transforms are normalized (inverse(forward(x)) == x). The DST-I is its
+ * own inverse up to a factor: applying it twice multiplies by (n + 1) / 2.
+ * Twiddles are computed in double, data is single precision.
+ */
+
+using ComplexF = std::complex<float>;
+
+/** Complex product without the NaN / Inf recovery of std::complex operator* (which compiles to a library call). */
+inline ComplexF complexMultiply(const ComplexF a, const ComplexF b)
+{
+    return ComplexF(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+}
+
+inline int nextPowerOfTwo(const int n)
+{
+    return int(std::bit_ceil(unsigned(std::max(n, 1))));
+}
+
+class FFT {
+public:
+    explicit FFT(const int new_size)
+        : n(new_size)
+        , bit_reversed(new_size)
+        , twiddles(new_size / 2)
+    {
+        assert(n > 0 && std::has_single_bit(unsigned(n)));
+        const int bits = std::countr_zero(unsigned(n));
+        for (int i = 0; i < n; i++) {
+            int r = 0;
+            for (int b = 0; b < bits; b++)
+                r |= ((i >> b) & 1) << (bits - 1 - b);
+            bit_reversed[i] = r;
+        }
+        for (int k = 0; k < n / 2; k++) {
+            const double angle = -2.0 * std::numbers::pi * k / n;
+            twiddles[k] = ComplexF(float(std::cos(angle)), float(std::sin(angle)));
+        }
+    }
+
+    int size() const { return n; }
+
+    /** In-place transform of n values. */
+    void forward(ComplexF* data) const { transform(data, false); }
+    void inverse(ComplexF* data) const
+    {
+        transform(data, true);
+        const float scale = 1.0f / float(n);
+        for (int i = 0; i < n; i++)
+            data[i] *= scale;
+    }
+
+private:
+    void transform(ComplexF* data, const bool inverse) const
+    {
+        for (int i = 0; i < n; i++)
+            if (i < bit_reversed[i])
+                std::swap(data[i], data[bit_reversed[i]]);
+
+        for (int length = 2; length <= n; length *= 2) {
+            const int half = length / 2;
+            const int step = n / length;
+            for (int start = 0; start < n; start += length) {
+                for (int k = 0; k < half; k++) {
+                    const ComplexF w = inverse ? std::conj(twiddles[size_t(k) * step]) : twiddles[size_t(k) * step];
+                    const ComplexF u = data[start + k];
+                    const ComplexF v = complexMultiply(data[start + k + half], w);
+                    data[start + k] = u + v;
+                    data[start + k + half] = u - v;
+                }
+            }
+        }
+    }
+
+    int n;
+    std::vector<int> bit_reversed;
+    std::vector<ComplexF> twiddles; // exp(-2 pi i k / n), k < n / 2.
+};
+
+class RealFFT {
+public:
+    explicit RealFFT(const int new_size)
+        : n(new_size)
+        , half_fft(std::max(new_size / 2, 1))
+        , twiddles(new_size / 2 + 1)
+    {
+        assert(n >= 2 && std::has_single_bit(unsigned(n)));
+        for (int k = 0; k <= n / 2; k++) {
+            const double angle = -2.0 * std::numbers::pi * k / n;
+            twiddles[k] = ComplexF(float(std::cos(angle)), float(std::sin(angle)));
+        }
+    }
+
+    int size() const { return n; }
+    int spectrumSize() const { return n / 2 + 1; }
+
+    /** n real samples -> n / 2 + 1 bins. `scratch` holds n / 2 values. */
+    void forward(const float* input, ComplexF* spectrum, ComplexF* scratch) const
+    {
+        const int m = n / 2;
+        // Pack even / odd samples as real / imaginary parts and split the result afterwards.
+        for (int k = 0; k < m; k++)
+            scratch[k] = ComplexF(input[2 * k], input[2 * k + 1]);
+        half_fft.forward(scratch);
+        for (int k = 0; k <= m; k++) {
+            const ComplexF z = scratch[k % m];
+            const ComplexF z_mirror = std::conj(scratch[(m - k) % m]);
+            const ComplexF even = 0.5f * (z + z_mirror);
+            const ComplexF odd = complexMultiply(ComplexF(0.0f, -0.5f), z - z_mirror);
+            spectrum[k] = even + complexMultiply(twiddles[k], odd);
+        }
+    }
+
+    /** n / 2 + 1 bins -> n real samples. `scratch` holds n / 2 values. */
+    void inverse(const ComplexF* spectrum, float* output, ComplexF* scratch) const
+    {
+        const int m = n / 2;
+        for (int k = 0; k < m; k++) {
+            const ComplexF x = spectrum[k];
+            const ComplexF x_mirror = std::conj(spectrum[m - k]);
+            const ComplexF even = 0.5f * (x + x_mirror);
+            const ComplexF odd = complexMultiply(0.5f * (x - x_mirror), std::conj(twiddles[k]));
+            scratch[k] = even + ComplexF(-odd.imag(), odd.real()); // even + i * odd
+        }
+        half_fft.inverse(scratch);
+        for (int k = 0; k < m; k++) {
+            output[2 * k] = scratch[k].real();
+            output[2 * k + 1] = scratch[k].imag();
+        }
+    }
+
+private:
+    int n;
+    FFT half_fft;
+    std::vector<ComplexF> twiddles; // exp(-2 pi i k / n), k <= n / 2.
+};
+
+class RealFFT2D {
+public:
+    RealFFT2D(const int new_width, const int new_height)
+        : width(new_width)
+        , height(new_height)
+        , row_fft(new_width)
+        , column_fft(new_height)
+    {
+    }
+
+    int spectrumWidth() const { return width / 2 + 1; }
+    size_t spectrumSize() const { return size_t(spectrumWidth()) * height; }
+
+    /** width x height real values (row-major, packed) -> spectrumWidth() x height bins (row-major). */
+    void forward(const float* input, ComplexF* spectrum) const
+    {
+        const int sw = spectrumWidth();
+        #pragma omp parallel
+        {
+            std::vector<ComplexF> scratch(std::max(width / 2, height));
+            #pragma omp for
+            for (int y = 0; y < height; y++)
+                row_fft.forward(input + size_t(y) * width, spectrum + size_t(y) * sw, scratch.data());
+            #pragma omp for
+            for (int x = 0; x < sw; x++)
+                transformColumn(spectrum, x, scratch.data(), false);
+        }
+    }
+
+    /** Inverse of forward(); `spectrum` is overwritten. */
+    void inverse(ComplexF* spectrum, float* output) const
+    {
+        const int sw = spectrumWidth();
+        #pragma omp parallel
+        {
+            std::vector<ComplexF> scratch(std::max(width / 2, height));
+            #pragma omp for
+            for (int x = 0; x < sw; x++)
+                transformColumn(spectrum, x, scratch.data(), true);
+            #pragma omp for
+            for (int y = 0; y < height; y++)
+                row_fft.inverse(spectrum + size_t(y) * sw, output + size_t(y) * width, scratch.data());
+        }
+    }
+
+    int width, height;
+
+private:
+    void transformColumn(ComplexF* spectrum, const int x, ComplexF* column, const bool inverse) const
+    {
+        const int sw = spectrumWidth();
+        for (int y = 0; y < height; y++)
+            column[y] = spectrum[size_t(y) * sw + x];
+        if (inverse)
+            column_fft.inverse(column);
+        else
+            column_fft.forward(column);
+        for (int y = 0; y < height; y++)
+            spectrum[size_t(y) * sw + x] = column[y];
+    }
+
+    RealFFT row_fft;
+    FFT column_fft;
+};
+
+/**
+ * Linear convolution of width x height images with a fixed (2 * radius_x + 1) x (2 * radius_y + 1) kernel,
+ * centered on the kernel middle. Pixels outside the image are zero. The images are padded to powers of two
+ * large enough to avoid wrap-around, and the kernel spectrum is computed once, so convolving many images
+ * with the same kernel costs two FFTs each.
+ */
+class FFTConvolver {
+public:
+    FFTConvolver(const int new_width, const int new_height, const ImageView<float>& kernel)
+        : width(new_width)
+        , height(new_height)
+        , fft(nextPowerOfTwo(std::max(new_width + kernel.width / 2, 2)), nextPowerOfTwo(std::max(new_height + kernel.height / 2, 2)))
+        , kernel_spectrum(fft.spectrumSize())
+    {
+        assert(kernel.width % 2 == 1 && kernel.height % 2 == 1);
+        const int rx = kernel.width / 2, ry = kernel.height / 2;
+        std::vector<float> padded(size_t(fft.width) * fft.height, 0.0f);
+        for (int y = -ry; y <= ry; y++)
+            for (int x = -rx; x <= rx; x++)
+                padded[size_t((y + fft.height) % fft.height) * fft.width + (x + fft.width) % fft.width] += kernel.at(x + rx, y + ry);
+        fft.forward(padded.data(), kernel_spectrum.data());
+    }
+
+    /** Returns image * kernel, cropped to the image size. */
+    Image<float> convolve(const ImageView<float>& image) const
+    {
+        assert(image.width == width && image.height == height);
+        std::vector<float> padded(size_t(fft.width) * fft.height, 0.0f);
+        #pragma omp parallel for
+        for (int y = 0; y < height; y++)
+            std::copy(image.row(y), image.row(y) + width, padded.begin() + size_t(y) * fft.width);
+
+        std::vector<ComplexF> spectrum(fft.spectrumSize());
+        fft.forward(padded.data(), spectrum.data());
+        #pragma omp parallel for
+        for (int i = 0; i < int(spectrum.size()); i++)
+            spectrum[i] = complexMultiply(spectrum[i], kernel_spectrum[i]);
+        fft.inverse(spectrum.data(), padded.data());
+
+        Image<float> result(width, height, {}, ImageInit::Uninitialized);
+        #pragma omp parallel for
+        for (int y = 0; y < height; y++)
+            std::copy(padded.begin() + size_t(y) * fft.width, padded.begin() + size_t(y) * fft.width + width, result.row(y));
+        return result;
+    }
+
+private:
+    int width, height;
+    RealFFT2D fft;
+    std::vector<ComplexF> kernel_spectrum;
+};
+
+/** Forward complex DFT of any size n with Bluestein's algorithm (a power-of-two FFT when n is one). */
+class BluesteinFFT {
+public:
+    explicit BluesteinFFT(const int new_size)
+        : n(new_size)
+        , fft(std::has_single_bit(unsigned(new_size)) ? new_size : nextPowerOfTwo(2 * new_size - 1))
+    {
+        assert(n > 0);
+        if (std::has_single_bit(unsigned(n)))
+            return;
+        // nk = (k^2 + n^2 - (k - n)^2) / 2, so X_k = w_k sum_j (x_j w_j) conj(w_(k - j)) with w_k = exp(-i pi k^2 / n).
+        chirp.resize(n);
+        for (int k = 0; k < n; k++) {
+            // k^2 mod 2n keeps the angle exact for large k.
+            const double angle = -std::numbers::pi * double((int64_t(k) * k) % (2 * int64_t(n))) / n;
+            chirp[k] = ComplexF(float(std::cos(angle)), float(std::sin(angle)));
+        }
+        kernel.assign(fft.size(), ComplexF(0.0f));
+        kernel[0] = std::conj(chirp[0]);
+        for (int k = 1; k < n; k++)
+            kernel[k] = kernel[fft.size() - k] = std::conj(chirp[k]);
+        fft.forward(kernel.data());
+    }
+
+    int size() const { return n; }
+    /** Values needed by forward() in `scratch`. */
+    int scratchSize() const { return chirp.empty() ? 0 : fft.size(); }
+
+    /** In-place transform of n values. */
+    void forward(ComplexF* data, ComplexF* scratch) const
+    {
+        if (chirp.empty()) {
+            fft.forward(data);
+            return;
+        }
+        const int m = fft.size();
+        for (int k = 0; k < n; k++)
+            scratch[k] = complexMultiply(data[k], chirp[k]);
+        std::fill(scratch + n, scratch + m, ComplexF(0.0f));
+        fft.forward(scratch);
+        for (int k = 0; k < m; k++)
+            scratch[k] = complexMultiply(scratch[k], kernel[k]);
+        fft.inverse(scratch);
+        for (int k = 0; k < n; k++)
+            data[k] = complexMultiply(scratch[k], chirp[k]);
+    }
+
+private:
+    int n;
+    FFT fft;
+    std::vector<ComplexF> chirp; // exp(-i pi k^2 / n); empty when n is a power of two.
+    std::vector<ComplexF> kernel; // Spectrum of conj(chirp) wrapped around index 0.
+};
+
+/**
+ * Type-I discrete sine transform of size n: y_k = sum_j x_j sin(pi (j + 1) (k + 1) / (n + 1)).
+ * The odd extension (0, x, 0, -reversed x) of length 2 (n + 1) has a purely imaginary DFT equal to -2i y, so two
+ * sequences a and b share one complex transform of a + i b: Im gives -2 y_a and Re gives 2 y_b.
+ */
+class DST {
+public:
+    explicit DST(const int new_size)
+        : n(new_size)
+        , fft(2 * (new_size + 1))
+    {
+        assert(n > 0);
+    }
+
+    int size() const { return n; }
+    /** Values needed by forward() in `scratch`. */
+    int scratchSize() const { return fft.size() + fft.scratchSize(); }
+
+    /** In-place transforms of a and b (n values each, read with the given strides); b may be null. */
+    void forward(float* a, float* b, ComplexF* scratch, const size_t stride = 1) const
+    {
+        const int extended = fft.size();
+        ComplexF* v = scratch;
+        v[0] = v[n + 1] = ComplexF(0.0f);
+        for (int j = 0; j < n; j++) {
+            const ComplexF x(a[j * stride], b ? b[j * stride] : 0.0f);
+            v[j + 1] = x;
+            v[extended - 1 - j] = -x;
+        }
+        fft.forward(v, scratch + extended);
+        for (int k = 0; k < n; k++) {
+            a[k * stride] = -0.5f * v[k + 1].imag();
+            if (b)
+                b[k * stride] = 0.5f * v[k + 1].real();
+        }
+    }
+
+private:
+    int n;
+    BluesteinFFT fft;
+};
+
+/** In-place 2D DST-I (rows, then columns) of a width x height float image. */
+class DST2D {
+public:
+    DST2D(const int new_width, const int new_height)
+        : width(new_width)
+        , height(new_height)
+        , row_dst(new_width)
+        , column_dst(new_height)
+    {
+    }
+
+    void forward(const MutableImageView<float>& image) const
+    {
+        assert(image.width == width && image.height == height);
+        #pragma omp parallel
+        {
+            std::vector<ComplexF> scratch(std::max(row_dst.scratchSize(), column_dst.scratchSize()));
+            #pragma omp for
+            for (int y = 0; y < height; y += 2)
+                row_dst.forward(image.row(y), y + 1 < height ? image.row(y + 1) : nullptr, scratch.data());
+            #pragma omp for
+            for (int x = 0; x < width; x += 2)
+                column_dst.forward(image.data + x, x + 1 < width ? image.data + x + 1 : nullptr, scratch.data(), size_t(image.stride));
+        }
+    }
+
+    int width, height;
+
+private:
+    DST row_dst, column_dst;
+};
@@ -0,0 +1,436 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "image.h"
+
+/*
+ * Separable Gaussian blur of Image<T> (float, glm::vec3, glm::vec4), pixels outside the image replicate the
+ * nearest border pixel.
+ *
+ * FIR: truncated kernel of radius ceil(3 sigma), exact up to the truncation; cost O(sigma) per pixel.
+ * Deriche: 4th-order causal + anti-causal recursive filter (Deriche 1993); O(1) per pixel, within about 0.1% of
+ *          the Gaussian for sigma >= 1.
+ * YoungVanVliet: 3rd-order forward + backward recursive filter (Young & van Vliet 1995); O(1) per pixel and
+ *          cheaper than Deriche, but only within a few percent of the Gaussian. The backward pass starts from the
+ *          exact response to the replicated border (Triggs & Sdika 2006).
+ * Auto picks FIR below sigma = 2 and Deriche above.
+ *
+ * Horizontal passes run one row per iteration, vertical passes run row after row over a strip of columns, so
+ * their inner loops are contiguous over x and vectorize across columns. Both are parallel.
+ */
+
+enum class GaussianBlurMethod {
+    Auto,
+    FIR,
+    Deriche,
+    YoungVanVliet
+};
+
+/** Columns per task of the vertical passes. */
+constexpr int GAUSSIAN_BLUR_COLUMN_STRIP = 256;
+
+/** Normalized Gaussian taps for offsets -radius..radius. */
+inline std::vector<float> gaussianKernel1D(const float sigma, const int radius)
+{
+    std::vector<float> kernel(2 * radius + 1);
+    double sum = 0.0;
+    for (int i = -radius; i <= radius; i++) {
+        const double w = std::exp(-double(i * i) / (2.0 * double(sigma) * sigma));
+        kernel[i + radius] = float(w);
+        sum += w;
+    }
+    for (auto& w : kernel)
+        w = float(w / sum);
+    return kernel;
+}
+
+template <typename T>
+void blurFIRHorizontal(const ImageView<T>& src, MutableImageView<T> dst, const std::vector<float>& kernel)
+{
+    const int radius = int(kernel.size()) / 2;
+    #pragma omp parallel
+    {
+        std::vector<T> padded(size_t(src.width) + 2 * radius);
+        #pragma omp for
+        for (int y = 0; y < src.height; y++) {
+            const T* in = src.row(y);
+            for (int i = 0; i < radius; i++) {
+                padded[i] = in[0];
+                padded[radius + src.width + i] = in[src.width - 1];
+            }
+            std::copy(in, in + src.width, padded.begin() + radius);
+
+            T* out = dst.row(y);
+            for (int x = 0; x < src.width; x++) {
+                T sum = padded[x] * kernel[0];
+                for (int k = 1; k <= 2 * radius; k++)
+                    sum += padded[x + k] * kernel[k];
+                out[x] = sum;
+            }
+        }
+    }
+}
+
+template <typename T>
+void blurFIRVertical(const ImageView<T>& src, MutableImageView<T> dst, const std::vector<float>& kernel)
+{
+    const int radius = int(kernel.size()) / 2;
+    const int strips = (src.width + GAUSSIAN_BLUR_COLUMN_STRIP - 1) / GAUSSIAN_BLUR_COLUMN_STRIP;
+    #pragma omp parallel for collapse(2)
+    for (int strip = 0; strip < strips; strip++) {
+        for (int y = 0; y < src.height; y++) {
+            const int x0 = strip * GAUSSIAN_BLUR_COLUMN_STRIP;
+            const int x1 = std::min(x0 + GAUSSIAN_BLUR_COLUMN_STRIP, src.width);
+            T* out = dst.row(y);
+            const T* first = src.row(std::clamp(y - radius, 0, src.height - 1));
+            #pragma omp simd
+            for (int x = x0; x < x1; x++)
+                out[x] = first[x] * kernel[0];
+            for (int k = 1; k <= 2 * radius; k++) {
+                const T* in = src.row(std::clamp(y - radius + k, 0, src.height - 1));
+                const float w = kernel[k];
+                #pragma omp simd
+                for (int x = x0; x < x1; x++)
+                    out[x] += in[x] * w;
+            }
+        }
+    }
+}
+
+/**
+ * Young / van Vliet coefficients: w[n] = B x[n] + b1 w[n-1] + b2 w[n-2] + b3 w[n-3] (already divided by b0), and
+ * the same recursion backwards on w.
+ */
+struct YoungVanVlietCoefficients {
+    float B, b1, b2, b3;
+    // Triggs & Sdika boundary: the backward outputs past the last sample, y[N], y[N+1], y[N+2], are
+    // u + boundary * (w[N-1] - u, w[N-2] - u, w[N-3] - u) for an input replicating u = x[N-1].
+    float boundary[3][3];
+
+    explicit YoungVanVlietCoefficients(const float sigma)
+    {
+        const double q = sigma >= 2.5f ? 0.98711 * sigma - 0.96330 : 3.97156 - 4.14554 * std::sqrt(1.0 - 0.26891 * sigma);
+        const double q2 = q * q, q3 = q2 * q;
+        const double c0 = 1.57825 + 2.44413 * q + 1.4281 * q2 + 0.422205 * q3;
+        const double c1 = 2.44413 * q + 2.85619 * q2 + 1.26661 * q3;
+        const double c2 = -(1.4281 * q2 + 1.26661 * q3);
+        const double c3 = 0.422205 * q3;
+        const double a[3] = { c1 / c0, c2 / c0, c3 / c0 };
+        b1 = float(a[0]);
+        b2 = float(a[1]);
+        b3 = float(a[2]);
+        B = float(1.0 - (c1 + c2 + c3) / c0);
+
+        // Run both passes past the end on each unit deviation of the forward state until it has decayed.
+        const int length = int(std::ceil(10.0f * sigma)) + 32;
+        std::vector<double> w(size_t(length) + 3), y(size_t(length) + 3);
+        for (int j = 0; j < 3; j++) {
+            std::fill(w.begin(), w.end(), 0.0);
+            std::fill(y.begin(), y.end(), 0.0);
+            w[2 - j] = 1.0; // w[0..2] hold w[N-3..N-1].
+            for (int n = 3; n < length + 3; n++)
+                w[n] = a[0] * w[n - 1] + a[1] * w[n - 2] + a[2] * w[n - 3];
+            for (int n = length - 1; n >= 3; n--)
+                y[n] = (1.0 - a[0] - a[1] - a[2]) * w[n] + a[0] * y[n + 1] + a[1] * y[n + 2] + a[2] * y[n + 3];
+            for (int i = 0; i < 3; i++)
+                boundary[i][j] = float(y[3 + i]);
+        }
+    }
+};
+
+/**
+ * Deriche 4th-order coefficients:
+ *   causal      y+[n] = n0 x[n] + n1 x[n-1] + n2 x[n-2] + n3 x[n-3] - d1 y+[n-1] - ... - d4 y+[n-4]
+ *   anti-causal y-[n] = m1 x[n+1] + ... + m4 x[n+4] - d1 y-[n+1] - ... - d4 y-[n+4]
+ *   y = y+ + y-, normalized to a unit DC gain.
+ */
+struct DericheCoefficients {
+    float n[4], m[4], d[4]; // m[k] multiplies x[n + k + 1], d[k] multiplies y[n -+ (k + 1)].
+    float causal_gain, anticausal_gain; // Steady-state response of each half to a constant 1 input.
+
+    explicit DericheCoefficients(const float sigma)
+    {
+        // Fit of the Gaussian by two pairs of complex exponentials (Deriche 1993).
+        const double a0 = 1.680, a1 = 3.735, b0 = 1.783, b1 = 1.723, w0 = 0.6318, w1 = 1.997, c0 = -0.6803, c1 = -0.2598;
+        const double cos0 = std::cos(w0 / sigma), sin0 = std::sin(w0 / sigma);
+        const double cos1 = std::cos(w1 / sigma), sin1 = std::sin(w1 / sigma);
+        const double e0 = std::exp(-b0 / sigma), e1 = std::exp(-b1 / sigma);
+
+        double nd[4], md[4], dd[4];
+        nd[0] = a0 + c0;
+        nd[1] = e1 * (c1 * sin1 - (c0 + 2.0 * a0) * cos1) + e0 * (a1 * sin0 - (2.0 * c0 + a0) * cos0);
+        nd[2] = 2.0 * e0 * e1 * ((a0 + c0) * cos1 * cos0 - a1 * cos1 * sin0 - c1 * cos0 * sin1) + c0 * e0 * e0 + a0 * e1 * e1;
+        nd[3] = e1 * e0 * e0 * (c1 * sin1 - c0 * cos1) + e0 * e1 * e1 * (a1 * sin0 - a0 * cos0);
+        dd[0] = -2.0 * e1 * cos1 - 2.0 * e0 * cos0;
+        dd[1] = 4.0 * cos1 * cos0 * e0 * e1 + e1 * e1 + e0 * e0;
+        dd[2] = -2.0 * cos0 * e0 * e1 * e1 - 2.0 * cos1 * e1 * e0 * e0;
+        dd[3] = e0 * e0 * e1 * e1;
+        for (int k = 0; k < 3; k++)
+            md[k] = nd[k + 1] - dd[k] * nd[0];
+        md[3] = -dd[3] * nd[0];
+
+        const double sum_n = nd[0] + nd[1] + nd[2] + nd[3];
+        const double sum_m = md[0] + md[1] + md[2] + md[3];
+        const double sum_d = 1.0 + dd[0] + dd[1] + dd[2] + dd[3];
+        const double scale = sum_d / (sum_n + sum_m);
+        for (int k = 0; k < 4; k++) {
+            n[k] = float(nd[k] * scale);
+            m[k] = float(md[k] * scale);
+            d[k] = float(dd[k]);
+        }
+        causal_gain = float(sum_n * scale / sum_d);
+        anticausal_gain = float(sum_m * scale / sum_d);
+    }
+};
+
+template <typename T>
+void blurYoungVanVlietHorizontal(const ImageView<T>& src, MutableImageView<T> dst, const YoungVanVlietCoefficients& c)
+{
+    #pragma omp parallel
+    {
+        std::vector<T> w(src.width);
+        #pragma omp for
+        for (int y = 0; y < src.height; y++) {
+            const T* in = src.row(y);
+            T* out = dst.row(y);
+            T w1 = in[0], w2 = in[0], w3 = in[0];
+            for (int x = 0; x < src.width; x++) {
+                w[x] = in[x] * c.B + w1 * c.b1 + w2 * c.b2 + w3 * c.b3;
+                w3 = w2;
+                w2 = w1;
+                w1 = w[x];
+            }
+            const T u = in[src.width - 1];
+            const T d0 = w[src.width - 1] - u;
+            const T d1 = (src.width >= 2 ? w[src.width - 2] : in[0]) - u;
+            const T d2 = (src.width >= 3 ? w[src.width - 3] : in[0]) - u;
+            T y1 = u + d0 * c.boundary[0][0] + d1 * c.boundary[0][1] + d2 * c.boundary[0][2];
+            T y2 = u + d0 * c.boundary[1][0] + d1 * c.boundary[1][1] + d2 * c.boundary[1][2];
+            T y3 = u + d0 * c.boundary[2][0] + d1 * c.boundary[2][1] + d2 * c.boundary[2][2];
+            for (int x = src.width - 1; x >= 0; x--) {
+                out[x] = w[x] * c.B + y1 * c.b1 + y2 * c.b2 + y3 * c.b3;
+                y3 = y2;
+                y2 = y1;
+                y1 = out[x];
+            }
+        }
+    }
+}
+
+template <typename T>
+void blurYoungVanVlietVertical(const ImageView<T>& src, MutableImageView<T> dst, const YoungVanVlietCoefficients& c)
+{
+    // The forward pass is stored in dst and read back for w[n-1..n-3]; the backward pass overwrites it from the
+    // bottom and keeps its last three rows in `state`, rotated.
+    const int strips = (src.width + GAUSSIAN_BLUR_COLUMN_STRIP - 1) / GAUSSIAN_BLUR_COLUMN_STRIP;
+    #pragma omp parallel
+    {
+        std::vector<T> state(3 * size_t(GAUSSIAN_BLUR_COLUMN_STRIP));
+        #pragma omp for
+        for (int strip = 0; strip < strips; strip++) {
+            const int x0 = strip * GAUSSIAN_BLUR_COLUMN_STRIP;
+            const int n = std::min(GAUSSIAN_BLUR_COLUMN_STRIP, src.width - x0);
+
+            // Rows before the image are the first input row (steady state of a constant signal).
+            const T* first = src.row(0) + x0;
+            for (int y = 0; y < src.height; y++) {
+                const T* in = src.row(y) + x0;
+                const T* w1 = y >= 1 ? dst.row(y - 1) + x0 : first;
+                const T* w2 = y >= 2 ? dst.row(y - 2) + x0 : first;
+                const T* w3 = y >= 3 ? dst.row(y - 3) + x0 : first;
+                T* out = dst.row(y) + x0;
+                #pragma omp simd
+                for (int x = 0; x < n; x++)
+                    out[x] = in[x] * c.B + w1[x] * c.b1 + w2[x] * c.b2 + w3[x] * c.b3;
+            }
+
+            T* previous[3] = { state.data(), state.data() + GAUSSIAN_BLUR_COLUMN_STRIP, state.data() + 2 * GAUSSIAN_BLUR_COLUMN_STRIP };
+            const T* u = src.row(src.height - 1) + x0;
+            const T* w1 = dst.row(src.height - 1) + x0;
+            const T* w2 = src.height >= 2 ? dst.row(src.height - 2) + x0 : first;
+            const T* w3 = src.height >= 3 ? dst.row(src.height - 3) + x0 : first;
+            for (int i = 0; i < 3; i++)
+                for (int x = 0; x < n; x++)
+                    previous[i][x] = u[x] + (w1[x] - u[x]) * c.boundary[i][0] + (w2[x] - u[x]) * c.boundary[i][1] + (w3[x] - u[x]) * c.boundary[i][2];
+            for (int y = src.height - 1; y >= 0; y--) {
+                T* out = dst.row(y) + x0;
+                T* next = previous[2];
+                const T* y1 = previous[0];
+                const T* y2 = previous[1];
+                #pragma omp simd
+                for (int x = 0; x < n; x++) {
+                    next[x] = out[x] * c.B + y1[x] * c.b1 + y2[x] * c.b2 + next[x] * c.b3;
+                    out[x] = next[x];
+                }
+                previous[2] = previous[1];
+                previous[1] = previous[0];
+                previous[0] = next;
+            }
+        }
+    }
+}
+
+template <typename T>
+void blurDericheHorizontal(const ImageView<T>& src, MutableImageView<T> dst, const DericheCoefficients& c)
+{
+    #pragma omp parallel
+    {
+        // Input row with 4 replicated pixels on both sides.
+        std::vector<T> padded(size_t(src.width) + 8);
+        #pragma omp for
+        for (int y = 0; y < src.height; y++) {
+            const T* in = src.row(y);
+            for (int i = 0; i < 4; i++) {
+                padded[i] = in[0];
+                padded[src.width + 4 + i] = in[src.width - 1];
+            }
+            std::copy(in, in + src.width, padded.begin() + 4);
+            const T* x_in = padded.data() + 4;
+            T* out = dst.row(y);
+
+            T y1 = in[0] * c.causal_gain, y2 = y1, y3 = y1, y4 = y1;
+            for (int x = 0; x < src.width; x++) {
+                const T value = x_in[x] * c.n[0] + x_in[x - 1] * c.n[1] + x_in[x - 2] * c.n[2] + x_in[x - 3] * c.n[3]
+                    - y1 * c.d[0] - y2 * c.d[1] - y3 * c.d[2] - y4 * c.d[3];
+                y4 = y3;
+                y3 = y2;
+                y2 = y1;
+                y1 = value;
+                out[x] = value;
+            }
+
+            y1 = in[src.width - 1] * c.anticausal_gain;
+            y2 = y3 = y4 = y1;
+            for (int x = src.width - 1; x >= 0; x--) {
+                const T value = x_in[x + 1] * c.m[0] + x_in[x + 2] * c.m[1] + x_in[x + 3] * c.m[2] + x_in[x + 4] * c.m[3]
+                    - y1 * c.d[0] - y2 * c.d[1] - y3 * c.d[2] - y4 * c.d[3];
+                y4 = y3;
+                y3 = y2;
+                y2 = y1;
+                y1 = value;
+                out[x] += value;
+            }
+        }
+    }
+}
+
+template <typename T>
+void blurDericheVertical(const ImageView<T>& src, MutableImageView<T> dst, const DericheCoefficients& c)
+{
+    // Inputs are read from src (rows clamped), the last four outputs of each half are kept in `state` and rotated.
+    const int strips = (src.width + GAUSSIAN_BLUR_COLUMN_STRIP - 1) / GAUSSIAN_BLUR_COLUMN_STRIP;
+    const int last_row = src.height - 1;
+    #pragma omp parallel
+    {
+        std::vector<T> state(4 * size_t(GAUSSIAN_BLUR_COLUMN_STRIP));
+        #pragma omp for
+        for (int strip = 0; strip < strips; strip++) {
+            const int x0 = strip * GAUSSIAN_BLUR_COLUMN_STRIP;
+            const int n = std::min(GAUSSIAN_BLUR_COLUMN_STRIP, src.width - x0);
+            T* previous[4];
+            for (int k = 0; k < 4; k++)
+                previous[k] = state.data() + size_t(k) * GAUSSIAN_BLUR_COLUMN_STRIP;
+
+            const T* first = src.row(0) + x0;
+            for (auto* row : previous)
+                for (int x = 0; x < n; x++)
+                    row[x] = first[x] * c.causal_gain;
+            for (int y = 0; y <= last_row; y++) {
+                const T* x0_row = src.row(y) + x0;
+                const T* x1_row = src.row(std::max(y - 1, 0)) + x0;
+                const T* x2_row = src.row(std::max(y - 2, 0)) + x0;
+                const T* x3_row = src.row(std::max(y - 3, 0)) + x0;
+                T* next = previous[3];
+                T* out = dst.row(y) + x0;
+                #pragma omp simd
+                for (int x = 0; x < n; x++) {
+                    next[x] = x0_row[x] * c.n[0] + x1_row[x] * c.n[1] + x2_row[x] * c.n[2] + x3_row[x] * c.n[3]
+                        - previous[0][x] * c.d[0] - previous[1][x] * c.d[1] - previous[2][x] * c.d[2] - next[x] * c.d[3];
+                    out[x] = next[x];
+                }
+                previous[3] = previous[2];
+                previous[2] = previous[1];
+                previous[1] = previous[0];
+                previous[0] = next;
+            }
+
+            const T* last = src.row(last_row) + x0;
+            for (auto* row : previous)
+                for (int x = 0; x < n; x++)
+                    row[x] = last[x] * c.anticausal_gain;
+            for (int y = last_row; y >= 0; y--) {
+                const T* x1_row = src.row(std::min(y + 1, last_row)) + x0;
+                const T* x2_row = src.row(std::min(y + 2, last_row)) + x0;
+                const T* x3_row = src.row(std::min(y + 3, last_row)) + x0;
+                const T* x4_row = src.row(std::min(y + 4, last_row)) + x0;
+                T* next = previous[3];
+                T* out = dst.row(y) + x0;
+                #pragma omp simd
+                for (int x = 0; x < n; x++) {
+                    next[x] = x1_row[x] * c.m[0] + x2_row[x] * c.m[1] + x3_row[x] * c.m[2] + x4_row[x] * c.m[3]
+                        - previous[0][x] * c.d[0] - previous[1][x] * c.d[1] - previous[2][x] * c.d[2] - next[x] * c.d[3];
+                    out[x] += next[x];
+                }
+                previous[3] = previous[2];
+                previous[2] = previous[1];
+                previous[1] = previous[0];
+                previous[0] = next;
+            }
+        }
+    }
+}
+
+/** Blurs `src` with a Gaussian of standard deviation `sigma` (in pixels) into `dst` (same size, may not alias). */
+template <typename T>
+void gaussianBlur(const ImageView<T>& src, MutableImageView<T> dst, const float sigma, GaussianBlurMethod method = GaussianBlurMethod::Auto)
+{
+    assert(src.width == dst.width && src.height == dst.height);
+    if (sigma <= 0.0f) {
+        dst.copyFrom(src);
+        return;
+    }
+    if (method == GaussianBlurMethod::Auto)
+        method = sigma < 2.0f ? GaussianBlurMethod::FIR : GaussianBlurMethod::Deriche;
+
+    Image<T> horizontal(src.width, src.height, {}, ImageInit::Uninitialized);
+    switch (method) {
+    case GaussianBlurMethod::Deriche: {
+        const DericheCoefficients c(sigma);
+        blurDericheHorizontal(src, horizontal.view(), c);
+        blurDericheVertical(std::as_const(horizontal).view(), dst, c);
+        break;
+    }
+    case GaussianBlurMethod::YoungVanVliet: {
+        const YoungVanVlietCoefficients c(sigma);
+        blurYoungVanVlietHorizontal(src, horizontal.view(), c);
+        blurYoungVanVlietVertical(std::as_const(horizontal).view(), dst, c);
+        break;
+    }
+    case GaussianBlurMethod::FIR:
+    default: {
+        const auto kernel = gaussianKernel1D(sigma, int(std::ceil(3.0f * sigma)));
+        blurFIRHorizontal(src, horizontal.view(), kernel);
+        blurFIRVertical(std::as_const(horizontal).view(), dst, kernel);
+        break;
+    }
+    }
+}
+
+template <typename T>
+Image<T> gaussianBlur(const ImageView<T>& src, const float sigma, const GaussianBlurMethod method = GaussianBlurMethod::Auto)
+{
+    Image<T> result(src.width, src.height, {}, ImageInit::Uninitialized);
+    gaussianBlur(src, result.view(), sigma, method);
+    return result;
+}
+
+template <typename T>
+Image<T> gaussianBlur(const Image<T>& src, const float sigma, const GaussianBlurMethod method = GaussianBlurMethod::Auto)
+{
+    return gaussianBlur(src.view(), sigma, method);
+}
@@ -2,107 +2,305 @@
 // Suppress warnings in third-party code.
 #include <framework/disable_all_warnings.h>
 
+#include <algorithm>
 #include <filesystem>
 #include <vector>
 #include <cassert>
 #include <exception>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <type_traits>
 #include <random>
 #include <functional>
 #include <fstream>
+#include <numeric>
+#include <utility>
+
+#include "aligned_allocator.h"
+#include "image_view.h"
+#include "image_expr.h"
+#include "image_file.h"
+#include "pixel_types.h"
+#include "tile_schedule.h"
 
 DISABLE_WARNINGS_PUSH()
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
 #include <stb/stb_image.h>
 #include <stb/stb_image_write.h>
 DISABLE_WARNINGS_POP()
 
 
+/**
+ * Memory layout of the pixel buffer of an Image.
+ * By default rows are packed (stride == width), so `data` can be indexed as y * width + x.
+ * A non-zero row_alignment pads each row so that every row starts on a row_alignment-byte boundary
+ * (the buffer itself is always IMAGE_ALIGNMENT-aligned). Padding elements are never read as pixels.
+ */
+struct ImageLayout {
+    int row_alignment = 0; // Row start alignment in bytes, 0 = packed rows. Must divide IMAGE_ALIGNMENT.
+    int min_stride = 0; // Minimal number of elements per row, 0 = width.
+
+    /** Rows padded to start on a cache line. */
+    static constexpr ImageLayout padded() { return { int(IMAGE_ALIGNMENT), 0 }; }
+
+    /** Number of elements between the starts of two consecutive rows. */
+    template <typename T>
+    int strideFor(const int width) const
+    {
+        auto stride = std::max(width, min_stride);
+        if (row_alignment > 0) {
+            assert(int(IMAGE_ALIGNMENT) % row_alignment == 0);
+            // Smallest number of elements spanning a whole number of alignment units (e.g. 16 for 12-byte vec3 and 64B).
+            const auto step = int(std::lcm(sizeof(T), size_t(row_alignment)) / sizeof(T));
+            stride = (stride + step - 1) / step * step;
+        }
+        return stride;
+    }
+};
+
+/** Initial content of a newly allocated image. */
+enum class ImageInit {
+    Zero, // All pixels are zero.
+    Uninitialized // Pixel values are unspecified; for kernels that overwrite every pixel anyway.
+};
+
 template <typename T>
 class Image {
 public:
-    Image(const std::filesystem::path& filePath);
-    Image(const int new_width, const int new_height);
+    using Storage = std::vector<T, AlignedAllocator<T>>;
+
+    Image(const std::filesystem::path& filePath, const ImageLayout& new_layout = {});
+    Image(const int new_width, const int new_height, const ImageLayout& new_layout = {}, const ImageInit init = ImageInit::Zero);
+    Image(const int new_width, const int new_height, const ImageLayout& new_layout, Storage&& storage);
+    explicit Image(const ImageView<T>& view, const ImageLayout& new_layout = {});
+    template <typename E>
+    Image(const ImageExpr<E>& expr, const ImageLayout& new_layout = {});
     Image(const Image&) = default;
+    /** The moved-from image is left empty (0 x 0). */
+    Image(Image&& other) noexcept;
     Image() : Image(1, 1) {};
 
+    Image& operator=(const Image&) = default;
+    Image& operator=(Image&& other) noexcept;
+    template <typename E>
+    Image& operator=(const ImageExpr<E>& expr);
+    void swap(Image& other) noexcept;
+
     void writeToFile(const std::filesystem::path& filePath, const float scaling_factor = 1.0f, const float noise_sigma = 0.0f);
-    void saveBinary(const std::filesystem::path& filePath);
+    void saveBinary(const std::filesystem::path& filePath) const;
     void readBinary(const std::filesystem::path& filePath);
 
 public:
     int width, height;
-    std::vector<T> data;
+    // Elements between two row starts (== width unless the layout pads rows).
+    int stride;
+    ImageLayout layout;
+    // Row-major pixels, row y starts at data[y * stride]. Linear indexing of `data` is only valid for packed images.
+    Storage data;
     inline T at(int x, int y) const;
     inline size_t size() const;
+    inline bool isPacked() const { return stride == width; }
+    inline T* row(int y) { return data.data() + size_t(y) * stride; }
+    inline const T* row(int y) const { return data.data() + size_t(y) * stride; }
+    inline ImageView<T> view() const { return ImageView<T>(*this); }
+    inline MutableImageView<T> view() { return MutableImageView<T>(*this); }
+    /** Zero-copy sub-rectangle [x, x + w) x [y, y + h). */
+    inline ImageView<T> roi(int x, int y, int w, int h) const { return view().roi(x, y, w, h); }
+    inline MutableImageView<T> roi(int x, int y, int w, int h) { return view().roi(x, y, w, h); }
     void apply(std::function<T(int, int)> kernel);
-    Image<T> operator*(float value);
-    Image<T> operator*(const float value) const;
+    template <typename Kernel>
+        requires std::is_invocable_r_v<T, Kernel&, int, int>
+    void apply(Kernel&& kernel, const TileSchedule& schedule = {});
+    template <typename TileKernel>
+    void applyTiles(TileKernel&& kernel, const TileSchedule& schedule = {});
+    // Lvalue images build lazy expressions (see image_expr.h), temporaries are scaled in place.
+    Image<T> operator*(const float value) &&;
     Image<T>& operator*=(float value);
-    Image<T>& operator+=(Image<T> &other);
     Image<T>& operator+=(const Image<T> &other);
+    template <typename E>
+    Image<T>& operator+=(const ImageExpr<E>& expr);
+    template <typename E>
+    Image<T>& operator*=(const ImageExpr<E>& expr);
     T& operator[](std::size_t index);
     const T operator[](std::size_t index) const;
 };
 
-/** Applies a custom kernel to the entire image without padding (borders are cropped). */
+template <typename T>
+ImageView<T>::ImageView(const Image<T>& image)
+    : ImageView(image.data.data(), image.width, image.height, image.stride) {}
+
+template <typename T>
+MutableImageView<T>::MutableImageView(Image<T>& image)
+    : MutableImageView(image.data.data(), image.width, image.height, image.stride) {}
+
+/** Materializes a view (e.g. an ROI) into a new image owning its pixels. */
+template <typename T>
+Image<T>::Image(const ImageView<T>& view, const ImageLayout& new_layout)
+    : Image(view.width, view.height, new_layout, ImageInit::Uninitialized)
+{
+    MutableImageView<T>(*this).copyFrom(view);
+}
+
+/**
+ * Applies a custom kernel to the entire image without padding (borders are cropped).
+ * Type-erased version kept for compatibility; lambdas bind to the inlined template overload below.
+ */
 template<typename T>
 void Image<T>::apply(std::function<T(int, int)> kernel) {
     #pragma omp parallel for
-    for (int y = 0; y < height; y++)
+    for (int y = 0; y < height; y++) {
+        T* dst = row(y);
         for (int x = 0; x < width; x++)
-            data[y * width + x] = kernel(x, y);
+            dst[x] = kernel(x, y);
+    }
 }
 
 
+/**
+ * Applies a custom kernel(x, y) to the entire image. The kernel is a template parameter, so it is inlined
+ * into the pixel loop, and pixels are visited in 2D tiles distributed over threads according to `schedule`.
+ */
 template<typename T>
-Image<T> Image<T>::operator*(float value) {
-    return static_cast<const Image<T>&>(*this) * value;
+template<typename Kernel>
+    requires std::is_invocable_r_v<T, Kernel&, int, int>
+void Image<T>::apply(Kernel&& kernel, const TileSchedule& schedule) {
+    forEachTile(width, height, schedule, [&](const int x0, const int y0, const int x1, const int y1) {
+        for (int y = y0; y < y1; y++) {
+            T* dst = row(y);
+            for (int x = x0; x < x1; x++)
+                dst[x] = kernel(x, y);
+        }
+    });
 }
 
+/**
+ * Hands whole tiles to kernel(tile, x0, y0), where `tile` is a writable view of the output tile and (x0, y0)
+ * its top-left pixel in the image. The kernel owns the loops over the tile rows, so it can vectorize them.
+ */
 template<typename T>
-Image<T> Image<T>::operator*(const float value) const {
-    Image<T> result(*this);
-    #pragma omp parallel for
-    for (int i = 0; i < size(); i++)
-        result[i] *= value;
+template<typename TileKernel>
+void Image<T>::applyTiles(TileKernel&& kernel, const TileSchedule& schedule) {
+    forEachTile(width, height, schedule, [&](const int x0, const int y0, const int x1, const int y1) {
+        kernel(roi(x0, y0, x1 - x0, y1 - y0), x0, y0);
+    });
+}
 
-    return result;
+template<typename T>
+Image<T>::Image(Image<T>&& other) noexcept
+    : width(std::exchange(other.width, 0))
+    , height(std::exchange(other.height, 0))
+    , stride(std::exchange(other.stride, 0))
+    , layout(other.layout)
+    , data(std::move(other.data))
+{
 }
 
 template<typename T>
-Image<T>& Image<T>::operator*=(float value) {
-    #pragma omp parallel for
-    for (int i = 0; i < size(); i++)
-        data[i] *= value;
+Image<T>& Image<T>::operator=(Image<T>&& other) noexcept {
+    // Moving into a temporary empties `other` whatever the allocator; the old buffer is freed with the temporary.
+    Image<T>(std::move(other)).swap(*this);
+    return *this;
+}
 
+/** Swaps the pixel buffers of two images without copying them. */
+template<typename T>
+void Image<T>::swap(Image<T>& other) noexcept {
+    std::swap(width, other.width);
+    std::swap(height, other.height);
+    std::swap(stride, other.stride);
+    std::swap(layout, other.layout);
+    data.swap(other.data);
+}
+
+template<typename T>
+void swap(Image<T>& a, Image<T>& b) noexcept {
+    a.swap(b);
+}
+
+/** Evaluates an expression into a new image in a single pass. */
+template <typename T>
+template <typename E>
+Image<T>::Image(const ImageExpr<E>& expr, const ImageLayout& new_layout)
+    : Image(expr.derived().width(), expr.derived().height(), new_layout, ImageInit::Uninitialized)
+{
+    *this = expr;
+}
+
+/** Evaluates an expression in one fused, parallel pass. The buffer is reused if the size matches. */
+template <typename T>
+template <typename E>
+Image<T>& Image<T>::operator=(const ImageExpr<E>& expr) {
+    const E& e = expr.derived();
+    if (e.width() != width || e.height() != height) {
+        // The expression may read *this, so evaluate into a fresh buffer.
+        Image<T> result(e.width(), e.height(), layout, ImageInit::Uninitialized);
+        result = expr;
+        return *this = std::move(result);
+    }
+
+    #pragma omp parallel for
+    for (int y = 0; y < height; y++) {
+        T* dst = row(y);
+        #pragma omp simd
+        for (int x = 0; x < width; x++)
+            dst[x] = PixelTraits<T>::fromCompute(PixelCompute<T>(e.eval(x, y)));
+    }
     return *this;
 }
 
+template <typename T>
+template <typename E>
+Image<T>& Image<T>::operator+=(const ImageExpr<E>& expr) {
+    return *this = *this + expr.derived();
+}
+
+template <typename T>
+template <typename E>
+Image<T>& Image<T>::operator*=(const ImageExpr<E>& expr) {
+    return *this = *this * expr.derived();
+}
+
+/** Temporaries are scaled in place and their buffer is moved into the result. */
+template<typename T>
+Image<T> Image<T>::operator*(const float value) && {
+    (*this) *= value;
+    return std::move(*this);
+}
+
 template<typename T>
-Image<T>& Image<T>::operator+=(Image<T> &other) {
-    return (*this) *= static_cast<const Image<T>&>(other);
+Image<T>& Image<T>::operator*=(float value) {
+    #pragma omp parallel for
+    for (int i = 0; i < int(data.size()); i++)
+        data[i] = PixelTraits<T>::fromCompute(PixelTraits<T>::toCompute(data[i]) * value);
+
+    return *this;
 }
 
 template<typename T>
 Image<T>& Image<T>::operator+=(const Image<T> &other) {
     #pragma omp parallel for
-    for (int i = 0; i < size(); i++)
-        data[i] += other[i];
+    for (int y = 0; y < height; y++) {
+        T* dst = row(y);
+        const T* src = other.row(y);
+        for (int x = 0; x < width; x++)
+            dst[x] = PixelTraits<T>::fromCompute(PixelTraits<T>::toCompute(dst[x]) + PixelTraits<T>::toCompute(src[x]));
+    }
 
     return *this;
 }
 
+/** Linear pixel index (y * width + x), mapped to the padded storage if needed. */
 template<typename T>
 T& Image<T>::operator[](std::size_t index) {
-    return data[index];
+    return isPacked() ? data[index] : data[(index / width) * stride + index % width];
 }
 
 template<typename T>
 const T Image<T>::operator[](std::size_t index) const {
-    return data[index];
+    return isPacked() ? data[index] : data[(index / width) * stride + index % width];
 }
 
 
@@ -112,6 +310,8 @@ template <>
 float stbToType<float>(const stbi_uc* src);
 template <>
 glm::vec3 stbToType<glm::vec3>(const stbi_uc* src);
+template <>
+glm::vec4 stbToType<glm::vec4>(const stbi_uc* src);
 
 template<typename T>
 inline T stbfToType(const float* src) { throw std::exception(); };
@@ -119,6 +319,8 @@ template <>
 float stbfToType<float>(const float* src);
 template <>
 glm::vec3 stbfToType<glm::vec3>(const float* src);
+template <>
+glm::vec4 stbfToType<glm::vec4>(const float* src);
 
 template <typename T>
 inline void typeToRgbUint8(stbi_uc* dst, const T& value) { throw std::exception(); };
@@ -126,6 +328,8 @@ template <>
 void typeToRgbUint8(stbi_uc* dst, const float& value);
 template <>
 void typeToRgbUint8(stbi_uc* dst, const glm::vec3& value);
+template <>
+void typeToRgbUint8(stbi_uc* dst, const glm::vec4& value);
 
 template <typename T>
 inline T sampleNoise(std::function<float(void)>& pdf) { throw std::exception(); };
@@ -133,9 +337,163 @@ template <>
 inline float sampleNoise(std::function<float(void)>& pdf) { return pdf(); }
 template <>
 inline glm::vec3 sampleNoise(std::function<float(void)>& pdf) { return glm::vec3(pdf(), pdf(), pdf()); }
+template <>
+inline glm::vec4 sampleNoise(std::function<float(void)>& pdf) { return glm::vec4(pdf(), pdf(), pdf(), 0.0f); }
+
+/*
+ * Row conversion kernels between stb buffers and image elements.
+ * Same results as the per-pixel stbToType / stbfToType / typeToRgbUint8, but written as flat loops
+ * over a whole row so that the compiler vectorizes them. Callers parallelize over rows.
+ */
+
+/** Number of color components of an element type (1 for scalar images, 3 for RGB, padding excluded). */
+template <typename T>
+constexpr int pixelComponents() { return std::is_arithmetic_v<PixelCompute<T>> ? 1 : 3; }
+
+/** Converts `count` interleaved 8-bit pixels with `channels` components to T in [0,1]. */
+template <typename T>
+void stbRowToType(const stbi_uc* src, const int channels, T* dst, const int count)
+{
+    if constexpr (std::is_same_v<T, float>) {
+        #pragma omp simd
+        for (int x = 0; x < count; x++)
+            dst[x] = float(src[x * channels]) / 255.0f;
+    } else if constexpr (std::is_same_v<T, uint8_t>) {
+        // 8-bit images store the file values as they are.
+        for (int x = 0; x < count; x++)
+            dst[x] = src[x * channels];
+    } else if constexpr (std::is_same_v<T, glm::u8vec3>) {
+        const int c1 = std::min(1, channels - 1);
+        const int c2 = std::min(2, channels - 1);
+        for (int x = 0; x < count; x++) {
+            const stbi_uc* px = src + x * channels;
+            dst[x] = glm::u8vec3(px[0], px[c1], px[c2]);
+        }
+    } else if constexpr (std::is_same_v<T, half>) {
+        for (int x = 0; x < count; x++)
+            dst[x] = half(float(src[x * channels]) / 255.0f);
+    } else if constexpr (std::is_same_v<T, glm::vec3> || std::is_same_v<T, glm::vec4>) {
+        // Gray and gray+alpha inputs replicate the first channel.
+        const int c1 = std::min(1, channels - 1);
+        const int c2 = std::min(2, channels - 1);
+        #pragma omp simd
+        for (int x = 0; x < count; x++) {
+            const stbi_uc* px = src + x * channels;
+            const auto rgb = glm::vec3(float(px[0]), float(px[c1]), float(px[c2])) / 255.0f;
+            if constexpr (std::is_same_v<T, glm::vec3>)
+                dst[x] = rgb;
+            else
+                dst[x] = glm::vec4(rgb, 0.0f);
+        }
+    } else {
+        for (int x = 0; x < count; x++)
+            dst[x] = stbToType<T>(src + x * channels);
+    }
+}
+
+/** Converts `count` interleaved float pixels with `channels` components to T. */
+template <typename T>
+void stbfRowToType(const float* src, const int channels, T* dst, const int count)
+{
+    if constexpr (std::is_same_v<T, float>) {
+        #pragma omp simd
+        for (int x = 0; x < count; x++)
+            dst[x] = src[x * channels];
+    } else if constexpr (std::is_same_v<T, half> || std::is_same_v<T, uint8_t>) {
+        for (int x = 0; x < count; x++)
+            dst[x] = PixelTraits<T>::fromCompute(src[x * channels]);
+    } else if constexpr (std::is_same_v<T, glm::u8vec3>) {
+        const int c1 = std::min(1, channels - 1);
+        const int c2 = std::min(2, channels - 1);
+        for (int x = 0; x < count; x++) {
+            const float* px = src + x * channels;
+            dst[x] = PixelTraits<T>::fromCompute(glm::vec3(px[0], px[c1], px[c2]));
+        }
+    } else if constexpr (std::is_same_v<T, glm::vec3> || std::is_same_v<T, glm::vec4>) {
+        const int c1 = std::min(1, channels - 1);
+        const int c2 = std::min(2, channels - 1);
+        #pragma omp simd
+        for (int x = 0; x < count; x++) {
+            const float* px = src + x * channels;
+            if constexpr (std::is_same_v<T, glm::vec3>)
+                dst[x] = glm::vec3(px[0], px[c1], px[c2]);
+            else
+                dst[x] = glm::vec4(px[0], px[c1], px[c2], 0.0f);
+        }
+    } else {
+        for (int x = 0; x < count; x++)
+            dst[x] = stbfToType<T>(src + x * channels);
+    }
+}
 
+/** [0,1] => [0,255] with clamping, truncating like the scalar conversion. NaN maps to 0 (e.g. 0 / 0 of a flat normalized image). */
+inline stbi_uc unitFloatToUint8(const float value)
+{
+    return !(value > 0.0f) ? stbi_uc(0) : stbi_uc(std::min(value, 1.0f) * 255);
+}
+
+/**
+ * Converts `count` elements to interleaved RGB8 (scalar images are replicated to 3 channels).
+ * Every component is multiplied by `scaling_factor` and offset by `noise` (pixelComponents<T>() values per pixel)
+ * unless `noise` is null.
+ */
 template <typename T>
-Image<T>::Image(const std::filesystem::path& filePath)
+void typeRowToRgbUint8(const T* src, const int count, const float scaling_factor, const float* noise, stbi_uc* dst)
+{
+    if constexpr (std::is_same_v<T, uint8_t> || std::is_same_v<T, glm::u8vec3>) {
+        // 8-bit images are written as stored unless they are scaled or dithered.
+        if (scaling_factor == 1.0f && !noise) {
+            for (int x = 0; x < count; x++) {
+                for (int c = 0; c < 3; c++) {
+                    if constexpr (std::is_same_v<T, uint8_t>)
+                        dst[3 * x + c] = src[x];
+                    else
+                        dst[3 * x + c] = src[x][c];
+                }
+            }
+            return;
+        }
+    }
+
+    if constexpr (std::is_same_v<PixelCompute<T>, float>) {
+        #pragma omp simd
+        for (int x = 0; x < count; x++) {
+            const auto value = unitFloatToUint8(PixelTraits<T>::toCompute(src[x]) * scaling_factor + (noise ? noise[x] : 0.0f));
+            dst[3 * x + 0] = value;
+            dst[3 * x + 1] = value;
+            dst[3 * x + 2] = value;
+        }
+    } else if constexpr (std::is_same_v<PixelCompute<T>, glm::vec3> || std::is_same_v<PixelCompute<T>, glm::vec4>) {
+        #pragma omp simd
+        for (int x = 0; x < count; x++) {
+            const auto value = PixelTraits<T>::toCompute(src[x]);
+            for (int c = 0; c < 3; c++) {
+                dst[3 * x + c] = unitFloatToUint8(value[c] * scaling_factor + (noise ? noise[3 * x + c] : 0.0f));
+            }
+        }
+    } else {
+        for (int x = 0; x < count; x++) {
+            typeToRgbUint8<T>(dst + 3 * x, src[x] * scaling_factor);
+        }
+    }
+}
+
+/**
+ * Converts `count` elements between two element types sharing a compute type
+ * (float <-> half <-> uint8_t, glm::vec3 <-> glm::u8vec3).
+ */
+template <typename To, typename From>
+void convertRow(const From* src, To* dst, const int count)
+{
+    static_assert(std::is_same_v<PixelCompute<To>, PixelCompute<From>>, "Element types must share a compute type.");
+    #pragma omp simd
+    for (int x = 0; x < count; x++)
+        dst[x] = PixelTraits<To>::fromCompute(PixelTraits<From>::toCompute(src[x]));
+}
+
+template <typename T>
+Image<T>::Image(const std::filesystem::path& filePath, const ImageLayout& new_layout)
+    : layout(new_layout)
 {
     if (!std::filesystem::exists(filePath)) {
         std::cerr << "Image file " << filePath << " does not exists!" << std::endl;
@@ -150,9 +508,11 @@ Image<T>::Image(const std::filesystem::path& filePath)
         stbi_hdr_to_ldr_scale(1.0f);
         float* stb_data_float = stbi_loadf(filePathStr.c_str(), &width, &height, &channels, 0);
 
-        data.resize(width * height);
-        for (size_t i = 0; i < data.size(); i++) {
-            data[i] = stbfToType<T>(stb_data_float + i * channels);
+        stride = layout.strideFor<T>(width);
+        data.resize(size_t(stride) * height);
+        #pragma omp parallel for
+        for (int y = 0; y < height; y++) {
+            stbfRowToType<T>(stb_data_float + size_t(y) * width * channels, channels, row(y), width);
         }
 
         stbi_image_free(stb_data_float);
@@ -164,9 +524,11 @@ Image<T>::Image(const std::filesystem::path& filePath)
             throw std::exception();
         }
 
-        data.resize(width * height);
-        for (size_t i = 0; i < data.size(); i++) {
-            data[i] = stbToType<T>(stb_data + i * channels);
+        stride = layout.strideFor<T>(width);
+        data.resize(size_t(stride) * height);
+        #pragma omp parallel for
+        for (int y = 0; y < height; y++) {
+            stbRowToType<T>(stb_data + size_t(y) * width * channels, channels, row(y), width);
         }
 
         stbi_image_free(stb_data);
@@ -176,11 +538,24 @@ Image<T>::Image(const std::filesystem::path& filePath)
 }
 
 template <typename T>
-Image<T>::Image(const int new_width, const int new_height)
+Image<T>::Image(const int new_width, const int new_height, const ImageLayout& new_layout, const ImageInit init)
 {
     width = new_width;
     height = new_height;
-    data.resize(width * height); // Should be full of zeros.
+    layout = new_layout;
+    stride = layout.strideFor<T>(width);
+    if (init == ImageInit::Zero)
+        data.resize(size_t(stride) * height, T {}); // Should be full of zeros.
+    else
+        data.resize(size_t(stride) * height); // Default-initialized, see AlignedAllocator::construct().
+}
+
+/** Adopts an existing buffer (e.g. recycled by ImagePool), which must hold exactly stride * height elements. */
+template <typename T>
+Image<T>::Image(const int new_width, const int new_height, const ImageLayout& new_layout, Storage&& storage)
+    : width(new_width), height(new_height), stride(new_layout.strideFor<T>(new_width)), layout(new_layout), data(std::move(storage))
+{
+    assert(data.size() == size_t(stride) * height);
 }
 
 template <typename T>
@@ -189,24 +564,29 @@ inline void Image<T>::writeToFile(const std::filesystem::path& filePath, const f
     // RGB => 3
     const auto channels = 3;
 
-    /*auto pdf = std::bind(std::normal_distribution<float>{0.0f, std::max(noise_sigma, 1e-5f)},
-        std::mt19937(std::random_device{}()));*/
-    auto pdf = std::bind(std::uniform_real_distribution<float>{-noise_sigma, noise_sigma},
-        std::mt19937(std::random_device{}()));
-    std::function<float(void)> pdf_sampler = pdf;
-
     // Converts floats to uint8 array. 
     // Assumes normalized format, so it is multiplied by 255 (on top of the scaling_factor).
     // If input is single channel, it triples it to get RGB.
-    std::vector<stbi_uc> std_data;
-    std_data.resize(width * height * channels);
-    for (size_t i = 0; i < data.size(); i++) {
-        auto val = data[i] * scaling_factor;
-        if (noise_sigma != 0.0f) {
-            val += sampleNoise<T>(pdf_sampler);
+    // Rows are converted in parallel; each row draws its noise from its own generator seeded from one random seed.
+    const auto seed = std::random_device {}();
+    std::unique_ptr<stbi_uc[]> std_data(new stbi_uc[size_t(width) * height * channels]);
+    #pragma omp parallel
+    {
+        std::vector<float> noise;
+        #pragma omp for
+        for (int y = 0; y < height; y++) {
+            const float* row_noise = nullptr;
+            if (noise_sigma != 0.0f) {
+                std::mt19937 rng(seed + unsigned(y));
+                std::uniform_real_distribution<float> pdf { -noise_sigma, noise_sigma };
+                noise.resize(size_t(width) * pixelComponents<T>());
+                for (auto& n : noise)
+                    n = pdf(rng);
+                row_noise = noise.data();
+            }
+            // Conversion handles [0,1] clamping.
+            typeRowToRgbUint8<T>(row(y), width, scaling_factor, row_noise, &std_data[size_t(y) * width * channels]);
         }
-        // Conversion handles [0,1] clamping.
-        typeToRgbUint8<T>(&std_data[i * channels], val);
     }
 
     // Create a folder.
@@ -217,15 +597,15 @@ inline void Image<T>::writeToFile(const std::filesystem::path& filePath, const f
     // Decide JPG (default) or PNG based on extension.
     const auto filePathStr = filePath.string(); // Create l-value so c_str() is safe.
     if (filePath.extension() == ".png") {
-        stbi_write_png(filePathStr.c_str(), width, height, channels, std_data.data(), width * channels);
+        stbi_write_png(filePathStr.c_str(), width, height, channels, std_data.get(), width * channels);
     } else {
-        stbi_write_jpg(filePathStr.c_str(), width, height, channels, std_data.data(), 95);
+        stbi_write_jpg(filePathStr.c_str(), width, height, channels, std_data.get(), 95);
     }
 };
 
 template <typename T>
 inline T Image<T>::at(int x, int y) const {
-    return data[y * width + x];
+    return data[size_t(y) * stride + x];
 }
 
 template <typename T>
@@ -233,29 +613,17 @@ inline size_t Image<T>::size() const {
     return width * height;
 }
 
+/** Stores the image as a single-plane image file (see image_file.h), keeping its stride. */
 template <typename T>
-inline void Image<T>::saveBinary(const std::filesystem::path& filePath) {
-    // Create directory if it doesn't exist
-    if (!std::filesystem::is_directory(filePath.parent_path())) {
-        std::filesystem::create_directories(filePath.parent_path());
-    }
-
-    std::ofstream file(filePath, std::ios::binary);
-    if (!file.is_open()) {
-        std::cerr << "Failed to open file for writing: " << filePath << std::endl;
-        throw std::exception();
-    }
-
-    // Write width and height
-    file.write(reinterpret_cast<const char*>(&width), sizeof(width));
-    file.write(reinterpret_cast<const char*>(&height), sizeof(height));
-
-    // Write pixel data
-    file.write(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(T));
-
-    file.close();
+inline void Image<T>::saveBinary(const std::filesystem::path& filePath) const {
+    const ImageView<T> planes[] = { view() };
+    writeImageFile<T>(filePath, planes);
 }
 
+/**
+ * Reads the first plane of an image file into this image (keeping this image's layout).
+ * Legacy files (raw width, height and packed pixels without a header) are detected and read as well.
+ */
 template <typename T>
 inline void Image<T>::readBinary(const std::filesystem::path& filePath) {
     if (!std::filesystem::exists(filePath)) {
@@ -269,13 +637,72 @@ inline void Image<T>::readBinary(const std::filesystem::path& filePath) {
         throw std::exception();
     }
 
-    // Read width and height
+    const auto header = readImageFileHeader(file);
+    if (header.isValid()) {
+        if (!header.holds<T>() || header.num_planes == 0) {
+            std::cerr << "Binary file " << filePath << " holds a different element type." << std::endl;
+            throw std::exception();
+        }
+        *this = Image<T>(header.width, header.height, layout, ImageInit::Uninitialized);
+        readImageFilePlane<T>(file, header, 0, view());
+        return;
+    }
+
+    // Legacy format: read width and height
+    file.clear();
+    file.seekg(0);
     file.read(reinterpret_cast<char*>(&width), sizeof(width));
     file.read(reinterpret_cast<char*>(&height), sizeof(height));
 
-    // Resize data vector and read pixel data
-    data.resize(width * height);
-    file.read(reinterpret_cast<char*>(data.data()), data.size() * sizeof(T));
+    // Resize data vector (keeping this image's layout) and read pixel data
+    stride = layout.strideFor<T>(width);
+    data.resize(size_t(stride) * height);
+    if (isPacked()) {
+        file.read(reinterpret_cast<char*>(data.data()), size() * sizeof(T));
+    } else {
+        for (int y = 0; y < height; y++)
+            file.read(reinterpret_cast<char*>(row(y)), width * sizeof(T));
+    }
     
     file.close();
 }
+
+/** Reads all planes of an image file into separate images with the given layout. */
+template <typename T>
+std::vector<Image<T>> readImageFilePlanes(const std::filesystem::path& filePath, const ImageLayout& layout = {})
+{
+    std::ifstream file(filePath, std::ios::binary);
+    const auto header = file.is_open() ? readImageFileHeader(file) : ImageFileHeader {};
+    if (!header.isValid() || !header.holds<T>()) {
+        std::cerr << "Failed to read image planes from " << filePath << std::endl;
+        throw std::exception();
+    }
+
+    std::vector<Image<T>> planes;
+    planes.reserve(header.num_planes);
+    for (uint32_t p = 0; p < header.num_planes; p++) {
+        planes.emplace_back(header.width, header.height, layout, ImageInit::Uninitialized);
+        readImageFilePlane<T>(file, header, p, planes.back().view());
+    }
+    return planes;
+}
+
+/**
+ * Converts an image to another element type with the same compute type, e.g. a float mask to uint8_t or an
+ * RGB result to glm::u8vec3 for storage. 8-bit conversions clamp to [0,1] and round to nearest.
+ */
+template <typename To, typename From>
+Image<To> convertImage(const ImageView<From>& src, const ImageLayout& layout = {})
+{
+    Image<To> result(src.width, src.height, layout, ImageInit::Uninitialized);
+    #pragma omp parallel for
+    for (int y = 0; y < src.height; y++)
+        convertRow<To, From>(src.row(y), result.row(y), src.width);
+    return result;
+}
+
+template <typename To, typename From>
+Image<To> convertImage(const Image<From>& src, const ImageLayout& layout = {})
+{
+    return convertImage<To, From>(src.view(), layout);
+}
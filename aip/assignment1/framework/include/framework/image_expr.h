@@ -0,0 +1,220 @@
+#pragma once
+// Suppress warnings in third-party code.
+#include <framework/disable_all_warnings.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <functional>
+#include <type_traits>
+
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+#include <glm/exponential.hpp>
+DISABLE_WARNINGS_POP()
+
+#include "image_view.h"
+#include "pixel_types.h"
+
+/*
+ * Lazy per-pixel arithmetic on images.
+ *
+ * Arithmetic on lvalue images (and views) builds a small expression tree instead of allocating
+ * a temporary image per operation. The tree is evaluated in a single fused, parallel pass when
+ * it is assigned to an Image (constructor, operator=, +=, *=). Expressions are element-wise, so
+ * `img = img * a + b` is safe. Expressions only reference their operands: do not store them
+ * in `auto` variables that outlive the images they were built from.
+ */
+
+/** CRTP base of all expression nodes. */
+template <typename Derived>
+struct ImageExpr {
+    const Derived& derived() const { return static_cast<const Derived&>(*this); }
+};
+
+/** Leaf reading pixels of an image or a view. Compact elements (half, 8-bit) are widened to their compute type. */
+template <typename T>
+struct ImageExprLeaf : ImageExpr<ImageExprLeaf<T>> {
+    using value_type = PixelCompute<T>;
+    static constexpr bool is_scalar = false;
+
+    ImageView<T> view;
+
+    explicit ImageExprLeaf(const ImageView<T>& new_view) : view(new_view) {}
+    int width() const { return view.width; }
+    int height() const { return view.height; }
+    value_type eval(int x, int y) const { return PixelTraits<T>::toCompute(view.row(y)[x]); }
+};
+
+/** Leaf broadcasting a scalar to every pixel. */
+template <typename S>
+struct ImageExprScalar : ImageExpr<ImageExprScalar<S>> {
+    using value_type = S;
+    static constexpr bool is_scalar = true;
+
+    S value;
+
+    explicit ImageExprScalar(const S new_value) : value(new_value) {}
+    int width() const { return 0; }
+    int height() const { return 0; }
+    S eval(int, int) const { return value; }
+};
+
+template <typename Op, typename A, typename B>
+struct ImageExprBinary : ImageExpr<ImageExprBinary<Op, A, B>> {
+    using value_type = decltype(Op {}(std::declval<typename A::value_type>(), std::declval<typename B::value_type>()));
+    static constexpr bool is_scalar = A::is_scalar && B::is_scalar;
+
+    A a;
+    B b;
+
+    ImageExprBinary(const A& new_a, const B& new_b) : a(new_a), b(new_b)
+    {
+        assert(A::is_scalar || B::is_scalar || (a.width() == b.width() && a.height() == b.height()));
+    }
+    int width() const { return A::is_scalar ? b.width() : a.width(); }
+    int height() const { return A::is_scalar ? b.height() : a.height(); }
+    value_type eval(int x, int y) const { return Op {}(a.eval(x, y), b.eval(x, y)); }
+};
+
+template <typename Op, typename A>
+struct ImageExprUnary : ImageExpr<ImageExprUnary<Op, A>> {
+    using value_type = decltype(std::declval<Op>()(std::declval<typename A::value_type>()));
+    static constexpr bool is_scalar = A::is_scalar;
+
+    A a;
+    Op op;
+
+    ImageExprUnary(const A& new_a, const Op& new_op) : a(new_a), op(new_op) {}
+    int width() const { return a.width(); }
+    int height() const { return a.height(); }
+    value_type eval(int x, int y) const { return op(a.eval(x, y)); }
+};
+
+/*
+ * Element-wise operations. Scalars use <cmath>, vectors the component-wise glm versions.
+ */
+
+struct ImageExpOp {
+    template <typename V>
+    V operator()(const V& v) const
+    {
+        if constexpr (std::is_arithmetic_v<V>)
+            return std::exp(v);
+        else
+            return glm::exp(v);
+    }
+};
+
+/** Natural log, values are clamped to `epsilon` first (same as logImage()). */
+struct ImageLogOp {
+    float epsilon;
+
+    template <typename V>
+    V operator()(const V& v) const
+    {
+        if constexpr (std::is_arithmetic_v<V>)
+            return std::log(std::max(v, V(epsilon)));
+        else
+            return glm::log(glm::max(v, V(epsilon)));
+    }
+};
+
+struct ImagePowOp {
+    float exponent;
+
+    template <typename V>
+    V operator()(const V& v) const
+    {
+        if constexpr (std::is_arithmetic_v<V>)
+            return std::pow(v, V(exponent));
+        else
+            return glm::pow(v, V(exponent));
+    }
+};
+
+struct ImageClampOp {
+    float lo, hi;
+
+    template <typename V>
+    V operator()(const V& v) const
+    {
+        if constexpr (std::is_arithmetic_v<V>)
+            return std::min(std::max(v, V(lo)), V(hi));
+        else
+            return glm::clamp(v, lo, hi);
+    }
+};
+
+/*
+ * Conversion of operands to expression nodes.
+ */
+
+template <typename X>
+struct IsImageOperand : std::false_type { };
+template <typename T>
+struct IsImageOperand<Image<T>> : std::true_type { };
+template <typename T>
+struct IsImageOperand<ImageView<T>> : std::true_type { };
+template <typename T>
+struct IsImageOperand<MutableImageView<T>> : std::true_type { };
+
+template <typename X>
+concept ImageExprOperand = std::is_base_of_v<ImageExpr<X>, X> || IsImageOperand<X>::value;
+template <typename X>
+concept ImageExprScalarOperand = std::is_arithmetic_v<X>;
+
+template <typename T>
+ImageExprLeaf<T> toImageExpr(const Image<T>& image) { return ImageExprLeaf<T>(ImageView<T>(image)); }
+template <typename T>
+ImageExprLeaf<T> toImageExpr(const ImageView<T>& view) { return ImageExprLeaf<T>(view); }
+template <typename T>
+ImageExprLeaf<T> toImageExpr(const MutableImageView<T>& view) { return ImageExprLeaf<T>(ImageView<T>(view)); }
+template <typename E>
+E toImageExpr(const ImageExpr<E>& expr) { return expr.derived(); }
+template <ImageExprScalarOperand S>
+ImageExprScalar<float> toImageExpr(const S value) { return ImageExprScalar<float>(float(value)); }
+
+template <typename A, typename B>
+concept ImageExprOperands = (ImageExprOperand<A> && (ImageExprOperand<B> || ImageExprScalarOperand<B>))
+    || (ImageExprScalarOperand<A> && ImageExprOperand<B>);
+
+template <typename Op, typename A, typename B>
+auto makeImageExprBinary(const A& a, const B& b)
+{
+    auto ea = toImageExpr(a);
+    auto eb = toImageExpr(b);
+    return ImageExprBinary<Op, decltype(ea), decltype(eb)>(ea, eb);
+}
+
+template <typename A, typename B>
+    requires ImageExprOperands<A, B>
+auto operator+(const A& a, const B& b) { return makeImageExprBinary<std::plus<>>(a, b); }
+
+template <typename A, typename B>
+    requires ImageExprOperands<A, B>
+auto operator-(const A& a, const B& b) { return makeImageExprBinary<std::minus<>>(a, b); }
+
+template <typename A, typename B>
+    requires ImageExprOperands<A, B>
+auto operator*(const A& a, const B& b) { return makeImageExprBinary<std::multiplies<>>(a, b); }
+
+template <typename A, typename B>
+    requires ImageExprOperands<A, B>
+auto operator/(const A& a, const B& b) { return makeImageExprBinary<std::divides<>>(a, b); }
+
+/** Lazy e^x. */
+template <ImageExprOperand A>
+auto lazyExp(const A& a) { return ImageExprUnary(toImageExpr(a), ImageExpOp {}); }
+
+/** Lazy ln(max(x, epsilon)). */
+template <ImageExprOperand A>
+auto lazyLog(const A& a, const float epsilon = 1e-8f) { return ImageExprUnary(toImageExpr(a), ImageLogOp { epsilon }); }
+
+/** Lazy x^exponent. */
+template <ImageExprOperand A>
+auto lazyPow(const A& a, const float exponent) { return ImageExprUnary(toImageExpr(a), ImagePowOp { exponent }); }
+
+/** Lazy clamp of every pixel (component) to [lo, hi]. */
+template <ImageExprOperand A>
+auto clamp(const A& a, const float lo, const float hi) { return ImageExprUnary(toImageExpr(a), ImageClampOp { lo, hi }); }
@@ -0,0 +1,282 @@
+#pragma once
+// Suppress warnings in third-party code.
+#include <framework/disable_all_warnings.h>
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <span>
+#include <vector>
+
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+DISABLE_WARNINGS_POP()
+
+#include "aligned_allocator.h"
+#include "image_view.h"
+#include "pixel_types.h"
+
+/*
+ * Versioned binary container for images (".bin").
+ *
+ * Layout: a 64-byte ImageFileHeader followed by `num_planes` planes of equal shape. Every plane starts on an
+ * IMAGE_ALIGNMENT boundary and stores `height` rows of `stride` elements, so a plane can be used in place
+ * (e.g. through MappedImageFile) as an ImageView with the stored stride. Values are little-endian.
+ *
+ * Files written before this format existed (raw `width, height, pixels` blobs) have no magic and are still
+ * accepted by Image::readBinary().
+ */
+
+/** Element type tag stored in the file. Values are part of the format, never renumber them. */
+enum class ImageElementType : uint32_t {
+    Unknown = 0,
+    Float32 = 1, // float
+    Vec3F32 = 2, // glm::vec3
+    Vec4F32 = 3, // glm::vec4 (padded RGB)
+    Float16 = 4, // half
+    UNorm8 = 5, // uint8_t, v / 255
+    Vec3UNorm8 = 6, // glm::u8vec3, v / 255
+};
+
+/** Bytes per element of a stored type, 0 for Unknown. */
+constexpr uint32_t imageElementSize(const ImageElementType type)
+{
+    switch (type) {
+    case ImageElementType::Float32:
+        return 4;
+    case ImageElementType::Vec3F32:
+        return 12;
+    case ImageElementType::Vec4F32:
+        return 16;
+    case ImageElementType::Float16:
+        return 2;
+    case ImageElementType::UNorm8:
+        return 1;
+    case ImageElementType::Vec3UNorm8:
+        return 3;
+    default:
+        return 0;
+    }
+}
+
+template <typename T>
+struct ImageElementTraits {
+    static constexpr ImageElementType type = ImageElementType::Unknown;
+    static constexpr uint32_t channels = 0;
+};
+template <>
+struct ImageElementTraits<float> {
+    static constexpr ImageElementType type = ImageElementType::Float32;
+    static constexpr uint32_t channels = 1;
+};
+template <>
+struct ImageElementTraits<glm::vec3> {
+    static constexpr ImageElementType type = ImageElementType::Vec3F32;
+    static constexpr uint32_t channels = 3;
+};
+template <>
+struct ImageElementTraits<glm::vec4> {
+    static constexpr ImageElementType type = ImageElementType::Vec4F32;
+    static constexpr uint32_t channels = 4;
+};
+template <>
+struct ImageElementTraits<half> {
+    static constexpr ImageElementType type = ImageElementType::Float16;
+    static constexpr uint32_t channels = 1;
+};
+template <>
+struct ImageElementTraits<uint8_t> {
+    static constexpr ImageElementType type = ImageElementType::UNorm8;
+    static constexpr uint32_t channels = 1;
+};
+template <>
+struct ImageElementTraits<glm::u8vec3> {
+    static constexpr ImageElementType type = ImageElementType::Vec3UNorm8;
+    static constexpr uint32_t channels = 3;
+};
+
+struct ImageFileHeader {
+    static constexpr std::array<char, 8> MAGIC = { 'A', 'I', 'P', 'I', 'M', 'A', 'G', 'E' };
+    static constexpr uint32_t VERSION = 1;
+
+    std::array<char, 8> magic = MAGIC;
+    uint32_t version = VERSION;
+    uint32_t header_size = sizeof(ImageFileHeader);
+    ImageElementType element_type = ImageElementType::Unknown;
+    uint32_t channels = 0; // Components per element.
+    uint32_t element_size = 0; // Bytes per element.
+    uint32_t num_planes = 0;
+    int32_t width = 0;
+    int32_t height = 0;
+    uint32_t stride = 0; // Elements per stored row.
+    uint32_t alignment = uint32_t(IMAGE_ALIGNMENT); // Byte alignment of the first plane and of the plane size.
+    uint64_t plane_bytes = 0; // Distance between two plane starts.
+    uint64_t reserved = 0;
+
+    bool isValid() const { return magic == MAGIC; }
+    /** Whether the fields describe a readable file: every plane offset and size below can then be trusted. */
+    bool isConsistent() const
+    {
+        // Planes are used in place, so they must start aligned for every element type.
+        if (header_size < sizeof(ImageFileHeader) || alignment < 16 || (alignment & (alignment - 1)) != 0)
+            return false;
+        if (width <= 0 || height <= 0 || stride < uint32_t(width) || num_planes == 0)
+            return false;
+        if (element_size == 0 || element_size != imageElementSize(element_type))
+            return false;
+        // Reject sizes whose byte counts would overflow (plane offsets are computed in 64 bits).
+        const uint64_t elements = uint64_t(stride) * uint64_t(height);
+        if (elements > (UINT64_MAX >> 1) / element_size)
+            return false;
+        return plane_bytes >= alignUp(elements * element_size) && plane_bytes % alignment == 0
+            && plane_bytes <= (UINT64_MAX - alignUp(header_size)) / num_planes;
+    }
+    uint64_t planeOffset(const uint32_t plane) const { return alignUp(header_size) + plane * plane_bytes; }
+    uint64_t alignUp(const uint64_t bytes) const { return (bytes + alignment - 1) / alignment * alignment; }
+
+    template <typename T>
+    bool holds() const { return element_type == ImageElementTraits<T>::type && element_size == sizeof(T); }
+};
+static_assert(sizeof(ImageFileHeader) == 64, "The file header must stay 64 bytes.");
+
+/**
+ * Reads the header, returns an invalid header (wrong magic) for legacy or foreign files.
+ * Throws if the magic matches but the file was written by a newer version of the format, or the other fields are
+ * inconsistent (see ImageFileHeader::isConsistent()).
+ */
+inline ImageFileHeader readImageFileHeader(std::istream& file)
+{
+    ImageFileHeader header;
+    header.magic = {};
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || !header.isValid()) {
+        header.magic = {};
+        return header;
+    }
+    // The fields of another version may mean something else, so they are not even checked.
+    if (header.version == 0 || header.version > ImageFileHeader::VERSION) {
+        std::cerr << "Image file has format version " << header.version << ", only versions up to " << ImageFileHeader::VERSION
+                  << " can be read." << std::endl;
+        throw std::exception();
+    }
+    if (!header.isConsistent()) {
+        std::cerr << "Image file header is corrupt (" << header.width << " x " << header.height << ", stride " << header.stride
+                  << ", alignment " << header.alignment << ")." << std::endl;
+        throw std::exception();
+    }
+    return header;
+}
+
+/** Writes equally sized planes into one file, keeping the stride of the first plane. */
+template <typename T>
+void writeImageFile(const std::filesystem::path& filePath, std::span<const ImageView<T>> planes)
+{
+    static_assert(ImageElementTraits<T>::type != ImageElementType::Unknown, "Element type cannot be stored.");
+    static_assert(imageElementSize(ImageElementTraits<T>::type) == sizeof(T), "Element size does not match its type.");
+    if (planes.empty())
+        throw std::exception();
+
+    if (!filePath.parent_path().empty() && !std::filesystem::is_directory(filePath.parent_path())) {
+        std::filesystem::create_directories(filePath.parent_path());
+    }
+    std::ofstream file(filePath, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open file for writing: " << filePath << std::endl;
+        throw std::exception();
+    }
+
+    ImageFileHeader header;
+    header.element_type = ImageElementTraits<T>::type;
+    header.channels = ImageElementTraits<T>::channels;
+    header.element_size = sizeof(T);
+    header.num_planes = uint32_t(planes.size());
+    header.width = planes[0].width;
+    header.height = planes[0].height;
+    header.stride = uint32_t(planes[0].stride);
+    header.plane_bytes = header.alignUp(uint64_t(header.stride) * header.height * sizeof(T));
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    const std::vector<char> zeros(std::max<size_t>(header.alignment, (header.stride - header.width) * sizeof(T)), 0);
+    for (uint32_t p = 0; p < header.num_planes; p++) {
+        const auto& plane = planes[p];
+        assert(plane.width == header.width && plane.height == header.height);
+        file.seekp(std::streamoff(header.planeOffset(p)));
+        for (int y = 0; y < plane.height; y++) {
+            file.write(reinterpret_cast<const char*>(plane.row(y)), std::streamsize(plane.width * sizeof(T)));
+            // Row padding is written as zeros (never the uninitialized padding of the source).
+            file.write(zeros.data(), std::streamsize((header.stride - header.width) * sizeof(T)));
+        }
+    }
+    // Pad the last plane to its full size so that mapping it never reads past the end of the file.
+    const auto end = header.planeOffset(header.num_planes);
+    file.seekp(std::streamoff(end - 1));
+    file.put(0);
+    file.flush();
+    if (!file) {
+        std::cerr << "Failed to write image file: " << filePath << std::endl;
+        throw std::exception();
+    }
+}
+
+/** Reads one plane of an opened file (positioned anywhere) into an equally sized view. */
+template <typename T>
+void readImageFilePlane(std::istream& file, const ImageFileHeader& header, const uint32_t plane, const MutableImageView<T>& dst)
+{
+    assert(header.holds<T>() && plane < header.num_planes);
+    assert(dst.width == header.width && dst.height == header.height);
+    for (int y = 0; y < header.height; y++) {
+        file.seekg(std::streamoff(header.planeOffset(plane) + uint64_t(y) * header.stride * sizeof(T)));
+        file.read(reinterpret_cast<char*>(dst.row(y)), std::streamsize(header.width * sizeof(T)));
+    }
+    if (!file) {
+        std::cerr << "Image file is truncated (plane " << plane << ")." << std::endl;
+        throw std::exception();
+    }
+}
+
+/**
+ * Read-only memory mapping of an image file. Planes are exposed as zero-copy ImageViews that stay valid as long
+ * as the MappedImageFile lives. Move-only.
+ */
+class MappedImageFile {
+public:
+    MappedImageFile() = default;
+    explicit MappedImageFile(const std::filesystem::path& filePath);
+    MappedImageFile(MappedImageFile&& other) noexcept;
+    MappedImageFile& operator=(MappedImageFile&& other) noexcept;
+    MappedImageFile(const MappedImageFile&) = delete;
+    MappedImageFile& operator=(const MappedImageFile&) = delete;
+    ~MappedImageFile();
+
+    const ImageFileHeader& header() const { return file_header; }
+    bool isOpen() const { return mapping != nullptr; }
+
+    template <typename T>
+    ImageView<T> plane(const uint32_t index = 0) const
+    {
+        if (!isOpen() || !file_header.holds<T>() || index >= file_header.num_planes) {
+            std::cerr << "Mapped image file does not contain plane " << index << " of the requested type." << std::endl;
+            throw std::exception();
+        }
+        const auto* ptr = reinterpret_cast<const T*>(static_cast<const char*>(mapping) + file_header.planeOffset(index));
+        return ImageView<T>(ptr, file_header.width, file_header.height, int(file_header.stride));
+    }
+
+private:
+    void unmap() noexcept;
+
+    ImageFileHeader file_header;
+    const void* mapping = nullptr;
+    size_t mapping_size = 0;
+#ifdef _WIN32
+    void* file_handle = nullptr;
+    void* mapping_handle = nullptr;
+#endif
+};
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <typeindex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "image.h"
+
+/**
+ * Recycles image buffers of pipeline intermediates.
+ *
+ * acquire<T>() hands out an image backed by a cached buffer of the same element type and element count if one
+ * was released before, and allocates a new one otherwise. release() returns the buffer to the pool instead of
+ * freeing it. Images that are never released simply stay "in use" for the statistics.
+ * All methods are thread-safe.
+ */
+class ImagePool {
+public:
+    ImagePool() = default;
+    ImagePool(const ImagePool&) = delete;
+    ImagePool& operator=(const ImagePool&) = delete;
+
+    /**
+     * Returns a width x height image. With ImageInit::Uninitialized a recycled buffer keeps its old content
+     * (and a fresh one is not zero-filled), which is what kernels overwriting every pixel want.
+     */
+    template <typename T>
+    Image<T> acquire(const int width, const int height, const ImageInit init = ImageInit::Zero, const ImageLayout& layout = {})
+    {
+        const auto count = size_t(layout.strideFor<T>(width)) * height;
+        typename Image<T>::Storage storage;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto& buffers = freeList<T>().buffers[count];
+            if (!buffers.empty()) {
+                storage = std::move(buffers.back());
+                buffers.pop_back();
+                bytes_cached -= count * sizeof(T);
+                num_reused++;
+            } else {
+                num_allocated++;
+            }
+            bytes_in_use += count * sizeof(T);
+            peak_bytes_in_use = std::max(peak_bytes_in_use, bytes_in_use);
+        }
+
+        if (storage.empty())
+            return Image<T>(width, height, layout, init);
+
+        auto image = Image<T>(width, height, layout, std::move(storage));
+        if (init == ImageInit::Zero)
+            image.view().fill(T {});
+        return image;
+    }
+
+    /** Same shape and layout as `like`. */
+    template <typename T, typename U>
+    Image<T> acquireLike(const Image<U>& like, const ImageInit init = ImageInit::Zero)
+    {
+        return acquire<T>(like.width, like.height, init, like.layout);
+    }
+
+    /** Gives the buffer of an image obtained from acquire() back to the pool. The image is left empty (0 x 0). */
+    template <typename T>
+    void release(Image<T>&& image)
+    {
+        recycle(std::move(image), true);
+    }
+
+    /** Takes over the buffer of an image that was allocated outside of the pool (it does not count as in use). */
+    template <typename T>
+    void adopt(Image<T>&& image)
+    {
+        recycle(std::move(image), false);
+    }
+
+    /** Frees all cached buffers. */
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        free_lists.clear();
+        bytes_cached = 0;
+    }
+
+    /** Bytes handed out by acquire() and not released yet. */
+    size_t bytesInUse() const { return locked(bytes_in_use); }
+    /** Maximum of bytesInUse() since construction. */
+    size_t peakBytesInUse() const { return locked(peak_bytes_in_use); }
+    /** Bytes held in released buffers waiting for reuse. */
+    size_t bytesCached() const { return locked(bytes_cached); }
+    size_t numAllocated() const { return locked(num_allocated); }
+    size_t numReused() const { return locked(num_reused); }
+
+private:
+    template <typename T>
+    void recycle(Image<T>&& image, const bool was_acquired)
+    {
+        auto storage = Image<T>(std::move(image)).data;
+        if (storage.empty())
+            return;
+
+        const auto bytes = storage.size() * sizeof(T);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (was_acquired)
+            bytes_in_use -= std::min(bytes_in_use, bytes);
+        bytes_cached += bytes;
+        freeList<T>().buffers[storage.size()].push_back(std::move(storage));
+    }
+
+    struct FreeListBase {
+        virtual ~FreeListBase() = default;
+    };
+
+    template <typename T>
+    struct FreeList : FreeListBase {
+        // Element count => released buffers of exactly that size.
+        std::unordered_map<size_t, std::vector<typename Image<T>::Storage>> buffers;
+    };
+
+    size_t locked(const size_t& counter) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return counter;
+    }
+
+    template <typename T>
+    FreeList<T>& freeList()
+    {
+        auto& list = free_lists[std::type_index(typeid(T))];
+        if (!list)
+            list = std::make_unique<FreeList<T>>();
+        return static_cast<FreeList<T>&>(*list);
+    }
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::type_index, std::unique_ptr<FreeListBase>> free_lists;
+    size_t bytes_in_use = 0;
+    size_t peak_bytes_in_use = 0;
+    size_t bytes_cached = 0;
+    size_t num_allocated = 0;
+    size_t num_reused = 0;
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+
+template <typename T>
+class Image;
+template <typename T>
+class MutableImageView;
+
+/**
+ * Non-owning read-only window into pixels laid out row by row with a given stride (in elements).
+ * Views are cheap to copy and are meant to be passed by value. The viewed image must outlive the view.
+ */
+template <typename T>
+class ImageView {
+public:
+    ImageView(const T* new_data, const int new_width, const int new_height, const int new_stride)
+        : data(new_data), width(new_width), height(new_height), stride(new_stride) {}
+    ImageView(const Image<T>& image);
+    ImageView(const MutableImageView<T>& view)
+        : ImageView(view.data, view.width, view.height, view.stride) {}
+
+public:
+    const T* data;
+    int width, height;
+    int stride;
+
+    inline T at(int x, int y) const { return data[size_t(y) * stride + x]; }
+    inline const T* row(int y) const { return data + size_t(y) * stride; }
+    inline size_t size() const { return size_t(width) * height; }
+    inline bool isPacked() const { return stride == width; }
+    /** Linear pixel index (y * width + x) within the view. */
+    inline T operator[](std::size_t index) const {
+        return isPacked() ? data[index] : data[(index / width) * stride + index % width];
+    }
+
+    /** Sub-rectangle [x, x + w) x [y, y + h) of this view. */
+    ImageView<T> roi(int x, int y, int w, int h) const
+    {
+        assert(x >= 0 && y >= 0 && x + w <= width && y + h <= height);
+        return ImageView<T>(row(y) + x, w, h, stride);
+    }
+};
+
+/**
+ * Non-owning writable window into pixels laid out row by row with a given stride (in elements).
+ * Converts implicitly to ImageView, so it can be passed to every kernel taking a read-only view.
+ */
+template <typename T>
+class MutableImageView {
+public:
+    MutableImageView(T* new_data, const int new_width, const int new_height, const int new_stride)
+        : data(new_data), width(new_width), height(new_height), stride(new_stride) {}
+    MutableImageView(Image<T>& image);
+
+public:
+    T* data;
+    int width, height;
+    int stride;
+
+    inline T& at(int x, int y) const { return data[size_t(y) * stride + x]; }
+    inline T* row(int y) const { return data + size_t(y) * stride; }
+    inline size_t size() const { return size_t(width) * height; }
+    inline bool isPacked() const { return stride == width; }
+    inline T& operator[](std::size_t index) const {
+        return isPacked() ? data[index] : data[(index / width) * stride + index % width];
+    }
+
+    MutableImageView<T> roi(int x, int y, int w, int h) const
+    {
+        assert(x >= 0 && y >= 0 && x + w <= width && y + h <= height);
+        return MutableImageView<T>(row(y) + x, w, h, stride);
+    }
+
+    /** Copies pixels of an equally sized view into this one (e.g. pastes a processed ROI back). */
+    void copyFrom(const ImageView<T>& src) const
+    {
+        assert(src.width == width && src.height == height);
+        #pragma omp parallel for
+        for (int y = 0; y < height; y++) {
+            const T* s = src.row(y);
+            T* d = row(y);
+            for (int x = 0; x < width; x++)
+                d[x] = s[x];
+        }
+    }
+
+    void fill(const T& value) const
+    {
+        #pragma omp parallel for
+        for (int y = 0; y < height; y++) {
+            T* d = row(y);
+            for (int x = 0; x < width; x++)
+                d[x] = value;
+        }
+    }
+
+    /** Applies a custom kernel to every pixel of the view, coordinates are relative to the view. */
+    template <typename Kernel>
+    void apply(Kernel&& kernel) const
+    {
+        #pragma omp parallel for
+        for (int y = 0; y < height; y++) {
+            T* d = row(y);
+            for (int x = 0; x < width; x++)
+                d[x] = kernel(x, y);
+        }
+    }
+};
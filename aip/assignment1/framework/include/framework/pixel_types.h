@@ -0,0 +1,130 @@
+#pragma once
+// Suppress warnings in third-party code.
+#include <framework/disable_all_warnings.h>
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+
+DISABLE_WARNINGS_PUSH()
+#include <glm/ext/vector_uint3_sized.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+DISABLE_WARNINGS_POP()
+
+/*
+ * Compact pixel element types and the mapping of every element type to the type used for arithmetic.
+ *
+ * - half: IEEE 754 binary16 storage, computed in float.
+ * - uint8_t / glm::u8vec3: normalized 8-bit storage (v / 255 maps to [0,1], like stb), computed in float / vec3.
+ *   Conversions to 8-bit clamp to [0,1] and round to nearest (NaN becomes 0).
+ */
+
+/** Float -> binary16 bits, round to nearest even, with subnormals, infinities and NaN. */
+inline uint16_t floatToHalfBits(const float value)
+{
+    const uint32_t x = std::bit_cast<uint32_t>(value);
+    const uint32_t sign = (x >> 16) & 0x8000u;
+    const uint32_t abs = x & 0x7fffffffu;
+
+    if (abs >= 0x7f800000u) // Inf or NaN (NaN stays quiet NaN).
+        return uint16_t(sign | 0x7c00u | (abs > 0x7f800000u ? 0x200u | ((abs >> 13) & 0x3ffu) : 0u));
+    if (abs >= 0x477ff000u) // Rounds to a value above the largest half (65504).
+        return uint16_t(sign | 0x7c00u);
+    if (abs < 0x38800000u) { // Half subnormal (below 2^-14).
+        if (abs < 0x33000000u) // Below 2^-25, rounds to zero.
+            return uint16_t(sign);
+        const uint32_t mantissa = (abs & 0x7fffffu) | 0x800000u;
+        const uint32_t shift = 126u - (abs >> 23);
+        uint32_t h = mantissa >> shift;
+        const uint32_t rest = mantissa & ((1u << shift) - 1u);
+        const uint32_t halfway = 1u << (shift - 1u);
+        if (rest > halfway || (rest == halfway && (h & 1u)))
+            h++;
+        return uint16_t(sign | h);
+    }
+    // Normal: rebias the exponent (127 -> 15) and round the 13 dropped mantissa bits.
+    uint32_t h = (abs - 0x38000000u) >> 13;
+    const uint32_t rest = abs & 0x1fffu;
+    if (rest > 0x1000u || (rest == 0x1000u && (h & 1u)))
+        h++;
+    return uint16_t(sign | h);
+}
+
+/** Binary16 bits -> float (exact). */
+inline float halfBitsToFloat(const uint16_t bits)
+{
+    const uint32_t sign = uint32_t(bits & 0x8000u) << 16;
+    const uint32_t exponent = (bits >> 10) & 0x1fu;
+    const uint32_t mantissa = bits & 0x3ffu;
+
+    if (exponent == 0) {
+        const float magnitude = float(mantissa) * 0x1p-24f;
+        return sign ? -magnitude : magnitude;
+    }
+    if (exponent == 31)
+        return std::bit_cast<float>(sign | 0x7f800000u | (mantissa << 13));
+    return std::bit_cast<float>(sign | ((exponent + 112u) << 23) | (mantissa << 13));
+}
+
+/** 16-bit float storage type. Trivially default constructible (uninitialized), arithmetic goes through float. */
+struct half {
+    uint16_t bits;
+
+    half() = default;
+    half(const float value) : bits(floatToHalfBits(value)) {}
+    operator float() const { return halfBitsToFloat(bits); }
+
+    half& operator+=(const float value) { return *this = float(*this) + value; }
+    half& operator-=(const float value) { return *this = float(*this) - value; }
+    half& operator*=(const float value) { return *this = float(*this) * value; }
+    half& operator/=(const float value) { return *this = float(*this) / value; }
+};
+static_assert(sizeof(half) == 2);
+
+/** [0,1] -> [0,255] rounded to nearest, clamped. NaN maps to 0 (converting it to an integer is undefined). */
+inline uint8_t unitFloatToUnorm8(const float value)
+{
+    if (std::isnan(value))
+        return 0;
+    return uint8_t(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+/**
+ * Element type -> arithmetic ("compute") type. toCompute()/fromCompute() convert one element; they are the identity
+ * for float, glm::vec3 and glm::vec4.
+ */
+template <typename T>
+struct PixelTraits {
+    using compute_type = T;
+    static compute_type toCompute(const T& value) { return value; }
+    static T fromCompute(const compute_type& value) { return value; }
+};
+
+template <>
+struct PixelTraits<half> {
+    using compute_type = float;
+    static float toCompute(const half value) { return float(value); }
+    static half fromCompute(const float value) { return half(value); }
+};
+
+template <>
+struct PixelTraits<uint8_t> {
+    using compute_type = float;
+    static float toCompute(const uint8_t value) { return float(value) / 255.0f; }
+    static uint8_t fromCompute(const float value) { return unitFloatToUnorm8(value); }
+};
+
+template <>
+struct PixelTraits<glm::u8vec3> {
+    using compute_type = glm::vec3;
+    static glm::vec3 toCompute(const glm::u8vec3& value) { return glm::vec3(float(value.x), float(value.y), float(value.z)) / 255.0f; }
+    static glm::u8vec3 fromCompute(const glm::vec3& value)
+    {
+        return glm::u8vec3(unitFloatToUnorm8(value.x), unitFloatToUnorm8(value.y), unitFloatToUnorm8(value.z));
+    }
+};
+
+template <typename T>
+using PixelCompute = typename PixelTraits<T>::compute_type;
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#include "image.h"
+
+/*
+ * Summed-area table (integral image) for O(1) box sums and means of any size.
+ *
+ * Entry (x, y) of the (width + 1) x (height + 1) table is the sum of all pixels above and left of pixel (x, y),
+ * so a box sum is four lookups. Sums are accumulated and stored in double: on a float table the corner values of a
+ * large image grow to ~1e7 and a box sum (difference of four of them) would lose most of its digits.
+ *
+ * Rows are prefix-summed in parallel, then each table row adds the row above, vectorized across columns.
+ */
+
+/** Accumulator used by SummedAreaTable<T>: T with double components. */
+template <typename T>
+struct SummedAreaAccumulator {
+    using type = double;
+};
+template <>
+struct SummedAreaAccumulator<glm::vec3> {
+    using type = glm::dvec3;
+};
+
+template <typename T>
+class SummedAreaTable {
+public:
+    using Accumulator = typename SummedAreaAccumulator<T>::type;
+
+    explicit SummedAreaTable(const ImageView<T>& image);
+    explicit SummedAreaTable(const Image<T>& image) : SummedAreaTable(image.view()) {}
+
+    /** Sum of the pixels in [x0, x1) x [y0, y1), clipped to the image. */
+    inline Accumulator sum(int x0, int y0, int x1, int y1) const;
+    /** Mean of the pixels of the (2 radius + 1)^2 box around (x, y), clipped to the image. */
+    inline Accumulator boxMean(int x, int y, int radius) const;
+    /** boxMean of every pixel. */
+    Image<T> boxMeans(int radius) const;
+
+public:
+    int width, height;
+    // (width + 1) x (height + 1), row-major; row 0 and column 0 are zero.
+    std::vector<Accumulator> table;
+
+private:
+    inline const Accumulator& entry(int x, int y) const { return table[size_t(y) * (width + 1) + x]; }
+};
+
+template <typename T>
+SummedAreaTable<T>::SummedAreaTable(const ImageView<T>& image)
+    : width(image.width)
+    , height(image.height)
+    , table(size_t(image.width + 1) * (image.height + 1), Accumulator(0.0))
+{
+    const size_t table_width = size_t(width) + 1;
+
+    #pragma omp parallel for
+    for (int y = 0; y < height; y++) {
+        const T* src = image.row(y);
+        Accumulator* dst = table.data() + (y + 1) * table_width;
+        Accumulator running(0.0);
+        for (int x = 0; x < width; x++) {
+            running += Accumulator(src[x]);
+            dst[x + 1] = running;
+        }
+    }
+
+    for (int y = 1; y < height; y++) {
+        const Accumulator* above = table.data() + y * table_width;
+        Accumulator* dst = table.data() + (y + 1) * table_width;
+        #pragma omp parallel for simd if (width > 4096)
+        for (int x = 1; x <= width; x++)
+            dst[x] += above[x];
+    }
+}
+
+template <typename T>
+inline typename SummedAreaTable<T>::Accumulator SummedAreaTable<T>::sum(int x0, int y0, int x1, int y1) const
+{
+    x0 = std::clamp(x0, 0, width);
+    x1 = std::clamp(x1, x0, width);
+    y0 = std::clamp(y0, 0, height);
+    y1 = std::clamp(y1, y0, height);
+    return entry(x1, y1) - entry(x0, y1) - entry(x1, y0) + entry(x0, y0);
+}
+
+template <typename T>
+inline typename SummedAreaTable<T>::Accumulator SummedAreaTable<T>::boxMean(const int x, const int y, const int radius) const
+{
+    const int x0 = std::max(x - radius, 0), x1 = std::min(x + radius + 1, width);
+    const int y0 = std::max(y - radius, 0), y1 = std::min(y + radius + 1, height);
+    return sum(x0, y0, x1, y1) / double((x1 - x0) * (y1 - y0));
+}
+
+template <typename T>
+Image<T> SummedAreaTable<T>::boxMeans(const int radius) const
+{
+    Image<T> result(width, height, {}, ImageInit::Uninitialized);
+    #pragma omp parallel for
+    for (int y = 0; y < height; y++) {
+        T* dst = result.row(y);
+        for (int x = 0; x < width; x++)
+            dst[x] = T(boxMean(x, y, radius));
+    }
+    return result;
+}
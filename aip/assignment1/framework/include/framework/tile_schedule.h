@@ -0,0 +1,55 @@
+#pragma once
+
+#include <algorithm>
+
+/** How a 2D iteration space is split into tiles and distributed over OpenMP threads. */
+struct TileSchedule {
+    enum class Policy {
+        Static, // Equal share of tiles per thread, cheapest when all pixels cost the same.
+        Dynamic, // Threads grab tiles one by one, good for uneven per-pixel cost (cropped kernels near borders).
+        Guided // Large chunks first, then smaller ones.
+    };
+
+    int tile_width = 64;
+    int tile_height = 16;
+    Policy policy = Policy::Dynamic;
+};
+
+/**
+ * Calls fn(x0, y0, x1, y1) for every tile [x0, x1) x [y0, y1) covering a width x height grid.
+ * Tiles are processed in parallel (row-major tile order), scheduled according to `schedule.policy`.
+ */
+template <typename TileFn>
+void forEachTile(const int width, const int height, const TileSchedule& schedule, TileFn&& fn)
+{
+    const int tile_w = std::max(1, schedule.tile_width);
+    const int tile_h = std::max(1, schedule.tile_height);
+    const int tiles_x = (width + tile_w - 1) / tile_w;
+    const int tiles_y = (height + tile_h - 1) / tile_h;
+    const int num_tiles = tiles_x * tiles_y;
+
+    auto run_tile = [&](const int tile) {
+        const int x0 = (tile % tiles_x) * tile_w;
+        const int y0 = (tile / tiles_x) * tile_h;
+        fn(x0, y0, std::min(x0 + tile_w, width), std::min(y0 + tile_h, height));
+    };
+
+    switch (schedule.policy) {
+    case TileSchedule::Policy::Static:
+        #pragma omp parallel for schedule(static)
+        for (int tile = 0; tile < num_tiles; tile++)
+            run_tile(tile);
+        break;
+    case TileSchedule::Policy::Guided:
+        #pragma omp parallel for schedule(guided)
+        for (int tile = 0; tile < num_tiles; tile++)
+            run_tile(tile);
+        break;
+    case TileSchedule::Policy::Dynamic:
+    default:
+        #pragma omp parallel for schedule(dynamic)
+        for (int tile = 0; tile < num_tiles; tile++)
+            run_tile(tile);
+        break;
+    }
+}
@@ -0,0 +1,286 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+#include "image.h"
+
+/*
+ * Tiled (blocked) image storage for stencil-heavy kernels.
+ *
+ * Pixels are stored in square tiles of tile_size x tile_size elements, each tile contiguous, so the rows a
+ * stencil touches are tile_size elements apart instead of a full image row. Tiles are stored in row-major
+ * tile order, or in Morton (Z) order so that neighbouring tiles are also close in memory. Border tiles are
+ * allocated whole; elements outside the image are padding and never read as pixels.
+ *
+ * Stencils run tile by tile through applyStencil(): each tile is gathered together with a halo of `radius`
+ * pixels into a small contiguous buffer (HaloTile) that the kernel reads from.
+ */
+
+struct TiledLayout {
+    int tile_size = 64; // Tile edge in pixels, a power of two (32 or 64 keep a float tile plus halo in L1/L2).
+    bool morton = false; // Store tiles in Morton order instead of row-major tile order.
+};
+
+/** How halo pixels outside the image are filled. */
+enum class HaloBorder {
+    Zero, // Zero pixels.
+    Clamp // Nearest image pixel.
+};
+
+/** Interleaves the bits of x and y (x in the even bits). */
+inline uint64_t mortonCode(const uint32_t x, const uint32_t y)
+{
+    auto spread = [](uint64_t v) {
+        v = (v | (v << 16)) & 0x0000ffff0000ffffull;
+        v = (v | (v << 8)) & 0x00ff00ff00ff00ffull;
+        v = (v | (v << 4)) & 0x0f0f0f0f0f0f0f0full;
+        v = (v | (v << 2)) & 0x3333333333333333ull;
+        v = (v | (v << 1)) & 0x5555555555555555ull;
+        return v;
+    };
+    return spread(x) | (spread(y) << 1);
+}
+
+template <typename T>
+class TiledImage {
+public:
+    using Storage = std::vector<T, AlignedAllocator<T>>;
+
+    TiledImage(const int new_width, const int new_height, const TiledLayout& new_layout = {}, const ImageInit init = ImageInit::Zero);
+    /** Converts a row-major image (or ROI) to the tiled layout. */
+    explicit TiledImage(const ImageView<T>& src, const TiledLayout& new_layout = {});
+    explicit TiledImage(const Image<T>& src, const TiledLayout& new_layout = {}) : TiledImage(src.view(), new_layout) {}
+
+    /** Converts back to a row-major image. */
+    Image<T> toImage(const ImageLayout& image_layout = {}) const;
+    void copyTo(MutableImageView<T> dst) const;
+    void copyFrom(const ImageView<T>& src);
+
+public:
+    int width, height;
+    TiledLayout layout;
+    int tiles_x, tiles_y;
+    // Tile s occupies data[s * tileElements(), (s + 1) * tileElements()), rows tile_size elements apart.
+    Storage data;
+
+    inline int tileCount() const { return tiles_x * tiles_y; }
+    inline size_t tileElements() const { return size_t(layout.tile_size) * layout.tile_size; }
+    /** Storage slot of tile (tx, ty). */
+    inline int tileSlot(int tx, int ty) const { return tile_slots[size_t(ty) * tiles_x + tx]; }
+    /** Tile coordinates stored in slot s (inverse of tileSlot). */
+    inline glm::ivec2 slotTile(int slot) const { return slot_tiles[slot]; }
+    inline T* tile(int tx, int ty) { return data.data() + tileSlot(tx, ty) * tileElements(); }
+    inline const T* tile(int tx, int ty) const { return data.data() + tileSlot(tx, ty) * tileElements(); }
+    /** View of the pixels of tile (tx, ty), clipped to the image. */
+    inline ImageView<T> tileView(int tx, int ty) const;
+    inline MutableImageView<T> tileView(int tx, int ty);
+    inline T at(int x, int y) const;
+    inline T& at(int x, int y);
+
+    /** Calls fn(tx, ty) for every tile, in parallel, in storage order. */
+    template <typename Fn>
+    void forEachTile(Fn&& fn) const;
+
+private:
+    inline size_t index(int x, int y) const;
+    void buildTileOrder();
+
+    std::vector<int> tile_slots;
+    std::vector<glm::ivec2> slot_tiles;
+};
+
+template <typename T>
+TiledImage<T>::TiledImage(const int new_width, const int new_height, const TiledLayout& new_layout, const ImageInit init)
+    : width(new_width), height(new_height), layout(new_layout)
+{
+    assert(layout.tile_size > 0 && (layout.tile_size & (layout.tile_size - 1)) == 0);
+    tiles_x = (width + layout.tile_size - 1) / layout.tile_size;
+    tiles_y = (height + layout.tile_size - 1) / layout.tile_size;
+    if (init == ImageInit::Zero)
+        data.resize(size_t(tileCount()) * tileElements(), T {});
+    else
+        data.resize(size_t(tileCount()) * tileElements());
+    buildTileOrder();
+}
+
+template <typename T>
+TiledImage<T>::TiledImage(const ImageView<T>& src, const TiledLayout& new_layout)
+    : TiledImage(src.width, src.height, new_layout, ImageInit::Uninitialized)
+{
+    copyFrom(src);
+}
+
+template <typename T>
+void TiledImage<T>::buildTileOrder()
+{
+    slot_tiles.resize(tileCount());
+    for (int ty = 0; ty < tiles_y; ty++)
+        for (int tx = 0; tx < tiles_x; tx++)
+            slot_tiles[size_t(ty) * tiles_x + tx] = glm::ivec2(tx, ty);
+    if (layout.morton) {
+        // Ranking the Morton codes keeps the storage compact for grids that are not square powers of two.
+        std::sort(slot_tiles.begin(), slot_tiles.end(), [](const glm::ivec2& a, const glm::ivec2& b) {
+            return mortonCode(uint32_t(a.x), uint32_t(a.y)) < mortonCode(uint32_t(b.x), uint32_t(b.y));
+        });
+    }
+    tile_slots.resize(tileCount());
+    for (int slot = 0; slot < tileCount(); slot++)
+        tile_slots[size_t(slot_tiles[slot].y) * tiles_x + slot_tiles[slot].x] = slot;
+}
+
+template <typename T>
+inline size_t TiledImage<T>::index(int x, int y) const
+{
+    const int shift = std::countr_zero(unsigned(layout.tile_size));
+    const int mask = layout.tile_size - 1;
+    return tileSlot(x >> shift, y >> shift) * tileElements() + size_t(y & mask) * layout.tile_size + (x & mask);
+}
+
+template <typename T>
+inline T TiledImage<T>::at(int x, int y) const { return data[index(x, y)]; }
+
+template <typename T>
+inline T& TiledImage<T>::at(int x, int y) { return data[index(x, y)]; }
+
+template <typename T>
+inline ImageView<T> TiledImage<T>::tileView(int tx, int ty) const
+{
+    const int ts = layout.tile_size;
+    return ImageView<T>(tile(tx, ty), std::min(ts, width - tx * ts), std::min(ts, height - ty * ts), ts);
+}
+
+template <typename T>
+inline MutableImageView<T> TiledImage<T>::tileView(int tx, int ty)
+{
+    const int ts = layout.tile_size;
+    return MutableImageView<T>(tile(tx, ty), std::min(ts, width - tx * ts), std::min(ts, height - ty * ts), ts);
+}
+
+template <typename T>
+template <typename Fn>
+void TiledImage<T>::forEachTile(Fn&& fn) const
+{
+    #pragma omp parallel for schedule(dynamic)
+    for (int slot = 0; slot < tileCount(); slot++)
+        fn(slot_tiles[slot].x, slot_tiles[slot].y);
+}
+
+template <typename T>
+void TiledImage<T>::copyFrom(const ImageView<T>& src)
+{
+    assert(src.width == width && src.height == height);
+    const int ts = layout.tile_size;
+    forEachTile([&](const int tx, const int ty) {
+        tileView(tx, ty).copyFrom(src.roi(tx * ts, ty * ts, std::min(ts, width - tx * ts), std::min(ts, height - ty * ts)));
+    });
+}
+
+template <typename T>
+void TiledImage<T>::copyTo(MutableImageView<T> dst) const
+{
+    assert(dst.width == width && dst.height == height);
+    const int ts = layout.tile_size;
+    forEachTile([&](const int tx, const int ty) {
+        const auto src = tileView(tx, ty);
+        dst.roi(tx * ts, ty * ts, src.width, src.height).copyFrom(src);
+    });
+}
+
+template <typename T>
+Image<T> TiledImage<T>::toImage(const ImageLayout& image_layout) const
+{
+    Image<T> result(width, height, image_layout, ImageInit::Uninitialized);
+    copyTo(result.view());
+    return result;
+}
+
+/**
+ * A tile together with a halo of `radius` pixels on each side, gathered into a contiguous buffer.
+ * at() takes image coordinates in [x0 - radius, x0 + width + radius) x [y0 - radius, y0 + height + radius).
+ */
+template <typename T>
+struct HaloTile {
+    ImageView<T> buffer; // (width + 2 * radius) x (height + 2 * radius)
+    int x0, y0; // Image coordinates of the first tile pixel.
+    int width, height; // Tile size without the halo (clipped to the image).
+    int radius;
+
+    inline T at(int x, int y) const { return buffer.at(x - x0 + radius, y - y0 + radius); }
+    /** Pointer to image row y at image column x (for kernels that loop over rows themselves). */
+    inline const T* ptr(int x, int y) const { return buffer.row(y - y0 + radius) + (x - x0 + radius); }
+};
+
+/**
+ * Gathers tile (tx, ty) of `src` and its halo into `storage` (resized as needed).
+ * Halo pixels outside the image are filled according to `border`.
+ */
+template <typename T>
+HaloTile<T> gatherHaloTile(const TiledImage<T>& src, const int tx, const int ty, const int radius, const HaloBorder border, std::vector<T>& storage)
+{
+    const int ts = src.layout.tile_size;
+    const int x0 = tx * ts, y0 = ty * ts;
+    const int tw = std::min(ts, src.width - x0), th = std::min(ts, src.height - y0);
+    const int bw = tw + 2 * radius, bh = th + 2 * radius;
+    storage.resize(size_t(bw) * bh);
+
+    for (int by = 0; by < bh; by++) {
+        T* dst = storage.data() + size_t(by) * bw;
+        int y = y0 - radius + by;
+        if (y < 0 || y >= src.height) {
+            if (border == HaloBorder::Zero) {
+                std::fill(dst, dst + bw, T {});
+                continue;
+            }
+            y = std::clamp(y, 0, src.height - 1);
+        }
+
+        // Left and right parts outside the image, then the in-image span copied tile row by tile row.
+        const int gx_begin = x0 - radius, gx_end = x0 + tw + radius;
+        const int in_begin = std::max(gx_begin, 0), in_end = std::min(gx_end, src.width);
+        for (int x = gx_begin; x < in_begin; x++)
+            dst[x - gx_begin] = border == HaloBorder::Zero ? T {} : src.at(0, y);
+        for (int x = in_end; x < gx_end; x++)
+            dst[x - gx_begin] = border == HaloBorder::Zero ? T {} : src.at(src.width - 1, y);
+
+        const int row_in_tile = y % ts;
+        for (int x = in_begin; x < in_end;) {
+            const int src_tx = x / ts;
+            const int span_end = std::min(in_end, (src_tx + 1) * ts);
+            const T* src_row = src.tile(src_tx, y / ts) + size_t(row_in_tile) * ts;
+            std::copy(src_row + (x - src_tx * ts), src_row + (span_end - src_tx * ts), dst + (x - gx_begin));
+            x = span_end;
+        }
+    }
+    return { ImageView<T>(storage.data(), bw, bh, bw), x0, y0, tw, th, radius };
+}
+
+/**
+ * Runs a stencil tile by tile: dst.at(x, y) = kernel(halo, x, y) for every pixel, where `halo` holds the
+ * source tile containing (x, y) plus `radius` pixels around it. The kernel uses image coordinates and must
+ * not read further than `radius` from (x, y). Tiles are processed in parallel with one halo buffer per thread.
+ */
+template <typename In, typename Out, typename Kernel>
+void applyStencil(const TiledImage<In>& src, TiledImage<Out>& dst, const int radius, const HaloBorder border, Kernel&& kernel)
+{
+    assert(src.width == dst.width && src.height == dst.height && src.layout.tile_size == dst.layout.tile_size);
+    #pragma omp parallel
+    {
+        std::vector<In> storage;
+        #pragma omp for schedule(dynamic)
+        for (int slot = 0; slot < dst.tileCount(); slot++) {
+            const auto t = dst.slotTile(slot);
+            const auto halo = gatherHaloTile(src, t.x, t.y, radius, border, storage);
+            auto out = dst.tileView(t.x, t.y);
+            for (int y = 0; y < halo.height; y++) {
+                Out* out_row = out.row(y);
+                for (int x = 0; x < halo.width; x++)
+                    out_row[x] = kernel(halo, halo.x0 + x, halo.y0 + y);
+            }
+        }
+    }
+}
@@ -14,6 +14,11 @@ glm::vec3 stbToType<glm::vec3>(const stbi_uc* src) {
     return glm::vec3(float(src[0]), float(src[1]), float(src[2])) / 255.0f;
 }
 
+template <>
+glm::vec4 stbToType<glm::vec4>(const stbi_uc* src) { 
+    return glm::vec4(stbToType<glm::vec3>(src), 0.0f);
+}
+
 template <>
 float stbfToType<float>(const float* src)
 {
@@ -26,12 +31,19 @@ glm::vec3 stbfToType<glm::vec3>(const float* src)
     return glm::vec3(src[0], src[1], src[2]);
 }
 
+template <>
+glm::vec4 stbfToType<glm::vec4>(const float* src)
+{
+    return glm::vec4(src[0], src[1], src[2], 0.0f);
+}
+
 
 
 
 inline auto floatToStb(const float value)
 {
-    return stbi_uc(std::min<float>(std::max<float>(value, 0.0f), 1.0f) * 255);
+    // NaN compares false and maps to 0, like negative values.
+    return !(value > 0.0f) ? stbi_uc(0) : stbi_uc(std::min<float>(value, 1.0f) * 255);
 }
 
 template<>
@@ -49,3 +61,10 @@ void typeToRgbUint8(stbi_uc* dst, const glm::vec3& value) {
     dst[1] = floatToStb(value.g);
     dst[2] = floatToStb(value.b);
 }
+
+template <>
+void typeToRgbUint8(stbi_uc* dst, const glm::vec4& value) {
+    dst[0] = floatToStb(value.r);
+    dst[1] = floatToStb(value.g);
+    dst[2] = floatToStb(value.b);
+}
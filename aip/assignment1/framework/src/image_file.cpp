@@ -0,0 +1,107 @@
+#include "image_file.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedImageFile::MappedImageFile(const std::filesystem::path& filePath)
+{
+    {
+        std::ifstream file(filePath, std::ios::binary);
+        if (!file.is_open()) {
+            std::cerr << "Failed to open file for reading: " << filePath << std::endl;
+            throw std::exception();
+        }
+        file_header = readImageFileHeader(file);
+        if (!file_header.isValid()) {
+            std::cerr << "File " << filePath << " is not a mappable image file (legacy or unknown format)." << std::endl;
+            throw std::exception();
+        }
+    }
+    mapping_size = size_t(file_header.planeOffset(file_header.num_planes));
+
+#ifdef _WIN32
+    file_handle = CreateFileW(filePath.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        file_handle = nullptr;
+        std::cerr << "Failed to open file for mapping: " << filePath << std::endl;
+        throw std::exception();
+    }
+    mapping_handle = CreateFileMappingW(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_handle) {
+        mapping = MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, mapping_size);
+    }
+#else
+    const int fd = ::open(filePath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Failed to open file for mapping: " << filePath << std::endl;
+        throw std::exception();
+    }
+    struct stat info;
+    if (::fstat(fd, &info) == 0 && size_t(info.st_size) >= mapping_size) {
+        void* ptr = ::mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr != MAP_FAILED) {
+            mapping = ptr;
+        }
+    }
+    // The mapping keeps its own reference to the file.
+    ::close(fd);
+#endif
+
+    if (!mapping) {
+        unmap();
+        std::cerr << "Failed to map image file " << filePath << std::endl;
+        throw std::exception();
+    }
+}
+
+MappedImageFile::MappedImageFile(MappedImageFile&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+MappedImageFile& MappedImageFile::operator=(MappedImageFile&& other) noexcept
+{
+    if (this != &other) {
+        unmap();
+        file_header = other.file_header;
+        std::swap(mapping, other.mapping);
+        std::swap(mapping_size, other.mapping_size);
+#ifdef _WIN32
+        std::swap(file_handle, other.file_handle);
+        std::swap(mapping_handle, other.mapping_handle);
+#endif
+    }
+    return *this;
+}
+
+MappedImageFile::~MappedImageFile()
+{
+    unmap();
+}
+
+void MappedImageFile::unmap() noexcept
+{
+#ifdef _WIN32
+    if (mapping)
+        UnmapViewOfFile(mapping);
+    if (mapping_handle)
+        CloseHandle(mapping_handle);
+    if (file_handle)
+        CloseHandle(file_handle);
+    file_handle = nullptr;
+    mapping_handle = nullptr;
+#else
+    if (mapping)
+        ::munmap(const_cast<void*>(mapping), mapping_size);
+#endif
+    mapping = nullptr;
+    mapping_size = 0;
+}
@@ -39,8 +39,8 @@ using ImageRGB = Image<glm::vec3>;
 /// <param name="a"></param>
 /// <param name="b"></param>
 /// <returns></returns>
-template <typename T>
-auto calcVectorRMSE(const std::vector<T>& a, const std::vector<T>& b)
+template <typename T, typename Alloc>
+auto calcVectorRMSE(const std::vector<T, Alloc>& a, const std::vector<T, Alloc>& b)
 {
     auto squareError = [](T a, T b) {
         auto e = a - b;
@@ -0,0 +1,162 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "helpers.h"
+#include "bilateral_simd.h"
+
+/*
+ * Bilateral filter with the window radius fixed at compile time.
+ *
+ * bilateralFilterFixed<R>() is instantiated for the common radii in BILATERAL_FIXED_RADII; the window, the loop
+ * trip counts and the spatial weight indices are constants, so the compiler fully unrolls the horizontal taps and
+ * keeps the weights in a stack array. Pixels whose window lies inside the image run an interior loop without any
+ * cropping; the cropped border pixels take bilateralPixelScalar() with the same weights. Other radii run the same
+ * kernel with a runtime radius (BILATERAL_DYNAMIC_RADIUS).
+ *
+ * space_sigma is a runtime parameter, so the spatial weights are computed once per call rather than at compile
+ * time. Window and cropping match the reference bilateralFilter; sums are accumulated in float (~1e-6 difference).
+ */
+
+/** Radii with a compile-time specialization (filter sizes 7, 11, 19 and 27). */
+constexpr std::array<int, 4> BILATERAL_FIXED_RADII = { 3, 5, 9, 13 };
+/** Template argument of bilateralFilterFixed selecting the runtime-radius kernel. */
+constexpr int BILATERAL_DYNAMIC_RADIUS = -1;
+
+/**
+ * exp(x) for x <= 0 (Cephes polynomial, ~1 ulp, same as exp256; results below exp(-87) are flushed to exp(-87)).
+ * Written with plain arithmetic so that the fixed-length lane loops below vectorize; std::exp is a library call.
+ */
+inline float bilateralExp(float x)
+{
+    // Clamp to -87 on the bits: for x <= 0 a larger magnitude is a larger signed integer. A float comparison would
+    // keep the loop scalar unless the build disables trapping math.
+    x = std::bit_cast<float>(std::min(std::bit_cast<int32_t>(x), std::bit_cast<int32_t>(-87.0f)));
+    // Round to nearest by adding and subtracting 1.5 * 2^23 (std::nearbyint is a library call without SSE4.1).
+    const float n = (x * 1.44269504088896341f + 12582912.0f) - 12582912.0f;
+    float r = x - n * 0.693359375f;
+    r = r - n * -2.12194440e-4f;
+
+    float p = 1.9875691500e-4f;
+    p = p * r + 1.3981999507e-3f;
+    p = p * r + 8.3334519073e-3f;
+    p = p * r + 4.1665795894e-2f;
+    p = p * r + 1.6666665459e-1f;
+    p = p * r + 5.0000001201e-1f;
+    p = p * (r * r) + (r + 1.0f);
+
+    // Multiply by 2^n through the exponent bits.
+    return p * std::bit_cast<float>(uint32_t(int32_t(n) + 127) << 23);
+}
+
+/** Output pixels computed together by the interior loop (one SSE/AVX register of floats, or two). */
+constexpr int BILATERAL_FIXED_LANES = 8;
+
+/**
+ * BILATERAL_FIXED_LANES uncropped output pixels starting at (x, y): taps [x - radius, x + radius) x
+ * [y - radius, y + radius) as in the reference. The lane loops have a constant trip count and no reductions, so
+ * they vectorize; the tap loops have constant trip counts for fixed radii.
+ */
+template <int Radius>
+inline void bilateralBlockInterior(const ImageFloatView H, const int x, const int y, const int runtime_radius, const float* spatial, const float range_coefficient, float* dst)
+{
+    const int radius = Radius == BILATERAL_DYNAMIC_RADIUS ? runtime_radius : Radius;
+    const int size = 2 * radius + 1;
+    const float* center = H.row(y) + x;
+    float sum[BILATERAL_FIXED_LANES] = {};
+    float k[BILATERAL_FIXED_LANES] = {};
+    for (int dy = -radius; dy < radius; dy++) {
+        const float* taps_row = H.row(y + dy) + x;
+        const float* spatial_row = spatial + size_t(dy + radius) * size + radius;
+        for (int dx = -radius; dx < radius; dx++) {
+            const float* taps = taps_row + dx;
+            const float spatial_weight = spatial_row[dx];
+            for (int lane = 0; lane < BILATERAL_FIXED_LANES; lane++) {
+                const float diff = center[lane] - taps[lane];
+                const float w = spatial_weight * bilateralExp(diff * diff * range_coefficient);
+                sum[lane] += w * taps[lane];
+                k[lane] += w;
+            }
+        }
+    }
+    for (int lane = 0; lane < BILATERAL_FIXED_LANES; lane++)
+        dst[x + lane] = sum[lane] / k[lane];
+}
+
+/// <summary>
+/// Bilateral filter with a compile-time radius (or a runtime one for BILATERAL_DYNAMIC_RADIUS); same window and
+/// border cropping as the reference bilateralFilter.
+/// </summary>
+template <int Radius>
+ImageFloat bilateralFilterFixed(const ImageFloatView H, const int size, const float space_sigma, const float range_sigma)
+{
+    assert(size % 2 == 1 && (Radius == BILATERAL_DYNAMIC_RADIUS || size / 2 == Radius));
+    const int radius = Radius == BILATERAL_DYNAMIC_RADIUS ? size / 2 : Radius;
+    const float range_coefficient = -1.0f / (2.0f * range_sigma * range_sigma);
+
+    // Fixed radii keep the weights on the stack; the runtime radius needs a heap buffer.
+    std::array<float, Radius == BILATERAL_DYNAMIC_RADIUS ? 1 : (2 * Radius + 1) * (2 * Radius + 1)> fixed_spatial;
+    std::vector<float> dynamic_spatial;
+    float* spatial = fixed_spatial.data();
+    if constexpr (Radius == BILATERAL_DYNAMIC_RADIUS) {
+        dynamic_spatial = bilateralSpatialWeights(size, space_sigma);
+        spatial = dynamic_spatial.data();
+    } else {
+        for (int dy = -Radius; dy <= Radius; dy++)
+            for (int dx = -Radius; dx <= Radius; dx++)
+                fixed_spatial[size_t(dy + Radius) * (2 * Radius + 1) + (dx + Radius)] = std::exp(-float(dx * dx + dy * dy) / (2.0f * space_sigma * space_sigma));
+    }
+
+    // Pixels in [radius, width - radius] x [radius, height - radius] have an uncropped window.
+    const int x_begin = std::min(radius, H.width), x_end = std::max(x_begin, H.width - radius + 1);
+    const int y_begin = std::min(radius, H.height), y_end = std::max(y_begin, H.height - radius + 1);
+
+    ImageFloat result(H.width, H.height, {}, ImageInit::Uninitialized);
+    #pragma omp parallel for schedule(dynamic)
+    for (int y = 0; y < H.height; y++) {
+        float* dst = result.row(y);
+        if (y < y_begin || y >= y_end) {
+            for (int x = 0; x < H.width; x++)
+                dst[x] = bilateralPixelScalar(H, x, y, radius, spatial, range_coefficient);
+            continue;
+        }
+        for (int x = 0; x < x_begin; x++)
+            dst[x] = bilateralPixelScalar(H, x, y, radius, spatial, range_coefficient);
+        int x = x_begin;
+        for (; x + BILATERAL_FIXED_LANES <= x_end; x += BILATERAL_FIXED_LANES)
+            bilateralBlockInterior<Radius>(H, x, y, radius, spatial, range_coefficient, dst);
+        for (; x < H.width; x++)
+            dst[x] = bilateralPixelScalar(H, x, y, radius, spatial, range_coefficient);
+    }
+    return result;
+}
+
+/** True if bilateralFilterFixedDispatch has a compile-time specialization for this filter size. */
+inline bool bilateralFixedRadiusSupported(const int size)
+{
+    return std::find(BILATERAL_FIXED_RADII.begin(), BILATERAL_FIXED_RADII.end(), size / 2) != BILATERAL_FIXED_RADII.end();
+}
+
+/// <summary>
+/// Runs the compile-time specialization for size / 2 when there is one, the runtime-radius kernel otherwise.
+/// </summary>
+ImageFloat bilateralFilterFixedDispatch(const ImageFloatView H, const int size, const float space_sigma, const float range_sigma)
+{
+    switch (size / 2) {
+    case 3:
+        return bilateralFilterFixed<3>(H, size, space_sigma, range_sigma);
+    case 5:
+        return bilateralFilterFixed<5>(H, size, space_sigma, range_sigma);
+    case 9:
+        return bilateralFilterFixed<9>(H, size, space_sigma, range_sigma);
+    case 13:
+        return bilateralFilterFixed<13>(H, size, space_sigma, range_sigma);
+    default:
+        return bilateralFilterFixed<BILATERAL_DYNAMIC_RADIUS>(H, size, space_sigma, range_sigma);
+    }
+}
@@ -0,0 +1,164 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "helpers.h"
+
+/*
+ * Bilateral grid (Paris & Durand 2006, Chen et al. 2007).
+ *
+ * The image is splatted into a 3D grid with one cell per space_sigma pixels in x and y and one cell per
+ * range_sigma in intensity, storing (sum of intensities, count) per cell. The grid is blurred with the
+ * [1 4 6 4 1] / 16 binomial kernel (a Gaussian of ~1 cell) along each axis and sliced back at every pixel with
+ * trilinear interpolation; dividing the two channels gives the filtered intensity.
+ *
+ * The cost is O(pixels + grid cells) and does not depend on space_sigma or on the window size: the spatial
+ * Gaussian is not truncated to a window, so results differ from the windowed reference near strong edges and
+ * by the grid discretization elsewhere (a few percent of range_sigma).
+ * The grid has about pixels / space_sigma^2 * (intensity range / range_sigma) cells, so it pays off for wide
+ * kernels; for space_sigma of one or two pixels the LUT backend is faster.
+ */
+
+struct BilateralGrid {
+    static constexpr int PADDING = 2; // Cells around the data, so the blur needs no bounds checks.
+
+    int width, height, depth; // Grid cells in x, y and intensity.
+    float space_scale; // Cells per pixel.
+    float range_scale; // Cells per intensity unit.
+    float range_min;
+    std::vector<glm::vec2> cells; // (sum of intensities, weight), index (z * height + y) * width + x.
+
+    BilateralGrid(const int image_width, const int image_height, const float min_value, const float max_value, const float space_sigma, const float range_sigma)
+        : space_scale(1.0f / space_sigma)
+        , range_scale(1.0f / range_sigma)
+        , range_min(min_value)
+    {
+        width = int(float(image_width - 1) * space_scale) + 2 + 2 * PADDING;
+        height = int(float(image_height - 1) * space_scale) + 2 + 2 * PADDING;
+        depth = int((max_value - min_value) * range_scale) + 2 + 2 * PADDING;
+        cells.assign(size_t(width) * height * depth, glm::vec2(0.0f));
+    }
+
+    inline size_t index(int x, int y, int z) const { return (size_t(z) * height + y) * width + x; }
+
+    /** Continuous grid coordinates of a pixel. */
+    inline glm::vec3 gridPosition(int x, int y, float value) const
+    {
+        return glm::vec3(float(x) * space_scale, float(y) * space_scale, (value - range_min) * range_scale) + float(PADDING);
+    }
+
+    /**
+     * Adds (value, 1) with trilinear weights to those of the 8 cells around grid position p that lie in grid row gy
+     * (p.y must be within one cell of gy).
+     */
+    void splat(const glm::vec3& p, const float value, const int gy)
+    {
+        const int x0 = int(p.x), y0 = int(p.y), z0 = int(p.z);
+        const glm::vec3 f = p - glm::vec3(float(x0), float(y0), float(z0));
+        const float wy = gy == y0 ? 1.0f - f.y : f.y;
+        for (int dz = 0; dz < 2; dz++) {
+            for (int dx = 0; dx < 2; dx++) {
+                const float w = (dx ? f.x : 1.0f - f.x) * wy * (dz ? f.z : 1.0f - f.z);
+                cells[index(x0 + dx, gy, z0 + dz)] += glm::vec2(w * value, w);
+            }
+        }
+    }
+
+    /** Trilinear interpolation of the cells at a continuous grid position. */
+    glm::vec2 slice(const glm::vec3& p) const
+    {
+        const int x0 = int(p.x), y0 = int(p.y), z0 = int(p.z);
+        const glm::vec3 f = p - glm::vec3(float(x0), float(y0), float(z0));
+        glm::vec2 result(0.0f);
+        for (int dz = 0; dz < 2; dz++) {
+            for (int dy = 0; dy < 2; dy++) {
+                for (int dx = 0; dx < 2; dx++) {
+                    const float w = (dx ? f.x : 1.0f - f.x) * (dy ? f.y : 1.0f - f.y) * (dz ? f.z : 1.0f - f.z);
+                    result += w * cells[index(x0 + dx, y0 + dy, z0 + dz)];
+                }
+            }
+        }
+        return result;
+    }
+
+    /** Blurs the cells with [1 4 6 4 1] / 16 along one axis (0 = x, 1 = y, 2 = z). Padding cells stay zero. */
+    void blurAxis(const int axis)
+    {
+        const size_t step = axis == 0 ? 1 : (axis == 1 ? size_t(width) : size_t(width) * height);
+        const int length = axis == 0 ? width : (axis == 1 ? height : depth);
+        const int lines_a = axis == 0 ? height : width;
+        const int lines_b = axis == 2 ? height : depth;
+
+        std::vector<glm::vec2> source = cells;
+        #pragma omp parallel for
+        for (int b = 0; b < lines_b; b++) {
+            for (int a = 0; a < lines_a; a++) {
+                const size_t start = axis == 0 ? index(0, a, b) : (axis == 1 ? index(a, 0, b) : index(a, b, 0));
+                for (int i = PADDING; i < length - PADDING; i++) {
+                    const size_t c = start + size_t(i) * step;
+                    cells[c] = (source[c - 2 * step] + source[c + 2 * step]
+                                   + 4.0f * (source[c - step] + source[c + step]) + 6.0f * source[c])
+                        / 16.0f;
+                }
+            }
+        }
+    }
+};
+
+/// <summary>
+/// Bilateral filter on a bilateral grid. Same signature as bilateralFilter; `size` is only validated, the
+/// spatial Gaussian is not truncated. The cost is independent of space_sigma.
+/// </summary>
+ImageFloat bilateralFilterGrid(const ImageFloatView H, const int size, const float space_sigma, const float range_sigma)
+{
+    assert(size % 2 == 1);
+
+    float min_value = std::numeric_limits<float>::max();
+    float max_value = std::numeric_limits<float>::lowest();
+    #pragma omp parallel for reduction(min : min_value) reduction(max : max_value)
+    for (int y = 0; y < H.height; y++) {
+        const float* src = H.row(y);
+        for (int x = 0; x < H.width; x++) {
+            min_value = std::min(min_value, src[x]);
+            max_value = std::max(max_value, src[x]);
+        }
+    }
+
+    BilateralGrid grid(H.width, H.height, min_value, max_value, space_sigma, range_sigma);
+
+    // Splat grid row by grid row: each grid row gathers the image rows that touch it, so threads never write the
+    // same cell (every image row is visited for the two grid rows it touches).
+    #pragma omp parallel for
+    for (int gy = 0; gy < grid.height; gy++) {
+        const int y_begin = std::max(0, int(float(gy - 1 - BilateralGrid::PADDING) * space_sigma) - 1);
+        const int y_end = std::min(H.height, int(float(gy + 1 - BilateralGrid::PADDING) * space_sigma) + 2);
+        for (int y = y_begin; y < y_end; y++) {
+            const float* src = H.row(y);
+            for (int x = 0; x < H.width; x++) {
+                const glm::vec3 p = grid.gridPosition(x, y, src[x]);
+                const int y0 = int(p.y);
+                if (y0 == gy || y0 + 1 == gy)
+                    grid.splat(p, src[x], gy);
+            }
+        }
+    }
+
+    for (int axis = 0; axis < 3; axis++)
+        grid.blurAxis(axis);
+
+    ImageFloat result(H.width, H.height, {}, ImageInit::Uninitialized);
+    #pragma omp parallel for
+    for (int y = 0; y < H.height; y++) {
+        const float* src = H.row(y);
+        float* dst = result.row(y);
+        for (int x = 0; x < H.width; x++) {
+            const glm::vec2 sample = grid.slice(grid.gridPosition(x, y, src[x]));
+            dst[x] = sample.y > 0.0f ? sample.x / sample.y : src[x];
+        }
+    }
+
+    return result;
+}
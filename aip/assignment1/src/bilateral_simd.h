@@ -0,0 +1,202 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+#include <framework/cpu_features.h>
+
+#include "helpers.h"
+
+/*
+ * Vectorized bilateral filter with the exact kernel.
+ *
+ * Output rows are processed in blocks of 8 (AVX2) or 16 (AVX-512) consecutive pixels. For every window row the
+ * block reads one contiguous span of input taps per horizontal offset, so each input row of the window is streamed
+ * once per output block and every load is a plain unaligned vector load. Spatial weights are precomputed, range
+ * weights use a vectorized exp (Cephes polynomial, ~1 ulp), sums are accumulated in float.
+ * Window and border cropping match the reference bilateralFilter; pixels whose window is cropped horizontally
+ * take the scalar path with the same weights. Results match the reference within float accumulation error
+ * (~1e-6 on log luminance).
+ */
+
+/** exp(-d^2 / (2 sigma^2)) for |d| <= radius, indexed by d + radius. */
+inline std::vector<float> bilateralSpatialWeights(const int size, const float space_sigma)
+{
+    const int radius = size / 2;
+    std::vector<float> weights(size_t(size) * size);
+    for (int dy = -radius; dy <= radius; dy++)
+        for (int dx = -radius; dx <= radius; dx++)
+            weights[size_t(dy + radius) * size + (dx + radius)] = std::exp(-float(dx * dx + dy * dy) / (2.0f * space_sigma * space_sigma));
+    return weights;
+}
+
+/** Scalar version of one output pixel, used for the cropped borders and when SIMD is not available. */
+inline float bilateralPixelScalar(const ImageFloatView H, const int x, const int y, const int radius, const float* spatial, const float range_coefficient)
+{
+    const int size = 2 * radius + 1;
+    const float center = H.at(x, y);
+    float sum = 0.0f;
+    float k = 0.0f;
+    const int kx_begin = std::max(0, x - radius);
+    const int kx_end = std::min(x + radius, H.width);
+    for (int ky = std::max(0, y - radius); ky < std::min(y + radius, H.height); ky++) {
+        const float* taps = H.row(ky);
+        const float* spatial_row = spatial + size_t(ky - y + radius) * size;
+        for (int kx = kx_begin; kx < kx_end; kx++) {
+            const float diff = center - taps[kx];
+            const float w = spatial_row[kx - x + radius] * std::exp(diff * diff * range_coefficient);
+            sum += w * taps[kx];
+            k += w;
+        }
+    }
+    return sum / k;
+}
+
+#if SIMD_X86
+
+/** exp(x) for x in [-87, 0] on 8 lanes. */
+SIMD_TARGET_AVX2 inline __m256 exp256(__m256 x)
+{
+    x = _mm256_max_ps(x, _mm256_set1_ps(-87.0f));
+    const __m256 n = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504088896341f)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 r = _mm256_fnmadd_ps(n, _mm256_set1_ps(0.693359375f), x);
+    r = _mm256_fnmadd_ps(n, _mm256_set1_ps(-2.12194440e-4f), r);
+
+    __m256 p = _mm256_set1_ps(1.9875691500e-4f);
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.3981999507e-3f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(8.3334519073e-3f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(4.1665795894e-2f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.6666665459e-1f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(5.0000001201e-1f));
+    p = _mm256_fmadd_ps(p, _mm256_mul_ps(r, r), _mm256_add_ps(r, _mm256_set1_ps(1.0f)));
+
+    // Multiply by 2^n through the exponent bits.
+    const __m256i exponent = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(p, _mm256_castsi256_ps(exponent));
+}
+
+/** Filters pixels [x_begin, x_end) of row y in blocks of 8; returns the first pixel not processed. */
+SIMD_TARGET_AVX2 inline int bilateralRowAvx2(const ImageFloatView H, const int y, const int radius, const float* spatial, const float range_coefficient, float* dst, const int x_begin, const int x_end)
+{
+    const int size = 2 * radius + 1;
+    const int ky_begin = std::max(0, y - radius);
+    const int ky_end = std::min(y + radius, H.height);
+    const __m256 coefficient = _mm256_set1_ps(range_coefficient);
+
+    int x = x_begin;
+    for (; x + 8 <= x_end; x += 8) {
+        const __m256 center = _mm256_loadu_ps(H.row(y) + x);
+        __m256 sum = _mm256_setzero_ps();
+        __m256 k = _mm256_setzero_ps();
+        for (int ky = ky_begin; ky < ky_end; ky++) {
+            const float* taps = H.row(ky) + x;
+            const float* spatial_row = spatial + size_t(ky - y + radius) * size + radius;
+            for (int dx = -radius; dx < radius; dx++) {
+                const __m256 tap = _mm256_loadu_ps(taps + dx);
+                const __m256 diff = _mm256_sub_ps(center, tap);
+                const __m256 w = _mm256_mul_ps(_mm256_set1_ps(spatial_row[dx]), exp256(_mm256_mul_ps(_mm256_mul_ps(diff, diff), coefficient)));
+                sum = _mm256_fmadd_ps(w, tap, sum);
+                k = _mm256_add_ps(k, w);
+            }
+        }
+        _mm256_storeu_ps(dst + x, _mm256_div_ps(sum, k));
+    }
+    return x;
+}
+
+/** exp(x) for x in [-87, 0] on 16 lanes. */
+SIMD_TARGET_AVX512 inline __m512 exp512(__m512 x)
+{
+    x = _mm512_max_ps(x, _mm512_set1_ps(-87.0f));
+    const __m512 n = _mm512_roundscale_ps(_mm512_mul_ps(x, _mm512_set1_ps(1.44269504088896341f)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512 r = _mm512_fnmadd_ps(n, _mm512_set1_ps(0.693359375f), x);
+    r = _mm512_fnmadd_ps(n, _mm512_set1_ps(-2.12194440e-4f), r);
+
+    __m512 p = _mm512_set1_ps(1.9875691500e-4f);
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(1.3981999507e-3f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(8.3334519073e-3f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(4.1665795894e-2f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(1.6666665459e-1f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(5.0000001201e-1f));
+    p = _mm512_fmadd_ps(p, _mm512_mul_ps(r, r), _mm512_add_ps(r, _mm512_set1_ps(1.0f)));
+
+    const __m512i exponent = _mm512_slli_epi32(_mm512_add_epi32(_mm512_cvtps_epi32(n), _mm512_set1_epi32(127)), 23);
+    return _mm512_mul_ps(p, _mm512_castsi512_ps(exponent));
+}
+
+/** Filters pixels [x_begin, x_end) of row y in blocks of 16; returns the first pixel not processed. */
+SIMD_TARGET_AVX512 inline int bilateralRowAvx512(const ImageFloatView H, const int y, const int radius, const float* spatial, const float range_coefficient, float* dst, const int x_begin, const int x_end)
+{
+    const int size = 2 * radius + 1;
+    const int ky_begin = std::max(0, y - radius);
+    const int ky_end = std::min(y + radius, H.height);
+    const __m512 coefficient = _mm512_set1_ps(range_coefficient);
+
+    int x = x_begin;
+    for (; x + 16 <= x_end; x += 16) {
+        const __m512 center = _mm512_loadu_ps(H.row(y) + x);
+        __m512 sum = _mm512_setzero_ps();
+        __m512 k = _mm512_setzero_ps();
+        for (int ky = ky_begin; ky < ky_end; ky++) {
+            const float* taps = H.row(ky) + x;
+            const float* spatial_row = spatial + size_t(ky - y + radius) * size + radius;
+            for (int dx = -radius; dx < radius; dx++) {
+                const __m512 tap = _mm512_loadu_ps(taps + dx);
+                const __m512 diff = _mm512_sub_ps(center, tap);
+                const __m512 w = _mm512_mul_ps(_mm512_set1_ps(spatial_row[dx]), exp512(_mm512_mul_ps(_mm512_mul_ps(diff, diff), coefficient)));
+                sum = _mm512_fmadd_ps(w, tap, sum);
+                k = _mm512_add_ps(k, w);
+            }
+        }
+        _mm512_storeu_ps(dst + x, _mm512_div_ps(sum, k));
+    }
+    return x;
+}
+
+#endif
+
+/** True if bilateralFilterSimd runs vectorized on this CPU. */
+inline bool bilateralSimdSupported()
+{
+    return cpuSupportsAvx2();
+}
+
+/// <summary>
+/// Bilateral filter with the exact kernel, vectorized with AVX-512 or AVX2 when the CPU supports them
+/// (scalar otherwise). Same window and border cropping as the reference bilateralFilter.
+/// </summary>
+ImageFloat bilateralFilterSimd(const ImageFloatView H, const int size, const float space_sigma, const float range_sigma)
+{
+    assert(size % 2 == 1);
+    const int radius = size / 2;
+    const std::vector<float> spatial = bilateralSpatialWeights(size, space_sigma);
+    const float range_coefficient = -1.0f / (2.0f * range_sigma * range_sigma);
+
+    // Pixels in [radius, width - radius] have an uncropped window horizontally: taps [x - radius, x + radius).
+    const int simd_begin = std::min(radius, H.width);
+    const int simd_end = std::max(simd_begin, H.width - radius + 1);
+    [[maybe_unused]] const bool use_avx512 = cpuSupportsAvx512();
+    [[maybe_unused]] const bool use_avx2 = cpuSupportsAvx2();
+
+    ImageFloat result(H.width, H.height, {}, ImageInit::Uninitialized);
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int y = 0; y < H.height; y++) {
+        float* dst = result.row(y);
+        int x = simd_begin;
+#if SIMD_X86
+        if (use_avx512)
+            x = bilateralRowAvx512(H, y, radius, spatial.data(), range_coefficient, dst, x, simd_end);
+        if (use_avx2)
+            x = bilateralRowAvx2(H, y, radius, spatial.data(), range_coefficient, dst, x, simd_end);
+#endif
+        // Cropped borders and the remainder of the vectorized span.
+        for (int px = 0; px < simd_begin; px++)
+            dst[px] = bilateralPixelScalar(H, px, y, radius, spatial.data(), range_coefficient);
+        for (int px = x; px < H.width; px++)
+            dst[px] = bilateralPixelScalar(H, px, y, radius, spatial.data(), range_coefficient);
+    }
+
+    return result;
+}
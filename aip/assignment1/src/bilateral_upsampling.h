@@ -0,0 +1,107 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+#include "helpers.h"
+#include "bilateral_simd.h"
+#include "fast_bilateral.h"
+
+/*
+ * Subsampled bilateral filter with joint bilateral upsampling (Kopf et al. 2007).
+ *
+ * H is box-downsampled by `factor`, filtered by the exact bilateral (bilateralFilterSimd) with the window and
+ * spatial sigma divided by `factor`, and brought back to full resolution by joint bilateral upsampling: every
+ * full-resolution pixel p averages the low-resolution results S(q) of the (2 JBU_RADIUS + 1)^2 neighbourhood of
+ * its position p_low, weighted by
+ *   exp(-|p_low - q|^2 / (2 JBU_SPACE_SIGMA^2)) * exp(-(H(p) - H_low(q))^2 / (2 range_sigma^2)),
+ * with H_low the downsampled H. The range term compares against the full-resolution H, so edges are placed at
+ * full resolution while the base layer itself is computed on factor^2 fewer pixels with a factor^2 smaller
+ * window. The upsampling costs (2 JBU_RADIUS + 1)^2 taps per pixel whatever the filter size.
+ */
+
+/** Low-resolution neighbourhood radius of the upsampling. */
+constexpr int JBU_RADIUS = 1;
+/** Spatial sigma of the upsampling, in low-resolution pixels. */
+constexpr float JBU_SPACE_SIGMA = 0.5f;
+
+/** Nearest low-resolution sample and spatial weights of its neighbourhood for every full-resolution coordinate. */
+struct JbuAxis {
+    std::vector<int> nearest;
+    std::vector<float> weights; // 2 JBU_RADIUS + 1 per coordinate, for nearest - JBU_RADIUS .. nearest + JBU_RADIUS.
+
+    JbuAxis(const int size, const int low_size, const int factor)
+        : nearest(size)
+        , weights(size_t(size) * (2 * JBU_RADIUS + 1))
+    {
+        for (int i = 0; i < size; i++) {
+            // Low-resolution pixel centers sit at (j + 0.5) * factor - 0.5 in full-resolution coordinates.
+            const float position = (float(i) + 0.5f) / float(factor) - 0.5f;
+            nearest[i] = std::clamp(int(std::lround(position)), 0, low_size - 1);
+            for (int k = -JBU_RADIUS; k <= JBU_RADIUS; k++) {
+                const float d = float(nearest[i] + k) - position;
+                weights[size_t(i) * (2 * JBU_RADIUS + 1) + k + JBU_RADIUS] = std::exp(-d * d / (2.0f * JBU_SPACE_SIGMA * JBU_SPACE_SIGMA));
+            }
+        }
+    }
+
+    inline const float* weightsAt(const int i) const { return weights.data() + size_t(i) * (2 * JBU_RADIUS + 1); }
+};
+
+/// <summary>
+/// Joint bilateral upsampling of `low` to the size of H, guided by H and by its downsampled version `low_guide`
+/// (both low-resolution images are H's size divided by `factor`, rounded up).
+/// </summary>
+ImageFloat jointBilateralUpsample(const ImageFloatView low, const ImageFloatView low_guide, const ImageFloatView H, const int factor, const float range_sigma)
+{
+    assert(low.width == (H.width + factor - 1) / factor && low.height == (H.height + factor - 1) / factor);
+    assert(low_guide.width == low.width && low_guide.height == low.height);
+    const float range_coefficient = -1.0f / (2.0f * range_sigma * range_sigma);
+    const JbuAxis axis_x(H.width, low.width, factor);
+    const JbuAxis axis_y(H.height, low.height, factor);
+
+    ImageFloat result(H.width, H.height, {}, ImageInit::Uninitialized);
+    #pragma omp parallel for
+    for (int y = 0; y < H.height; y++) {
+        const int cy = axis_y.nearest[y];
+        const float* wy = axis_y.weightsAt(y);
+        for (int x = 0; x < H.width; x++) {
+            const int cx = axis_x.nearest[x];
+            const float* wx = axis_x.weightsAt(x);
+            const float center = H.at(x, y);
+
+            float sum = 0.0f;
+            float k = 0.0f;
+            for (int qy = std::max(cy - JBU_RADIUS, 0); qy <= std::min(cy + JBU_RADIUS, low.height - 1); qy++) {
+                const float* values = low.row(qy);
+                const float* guides = low_guide.row(qy);
+                for (int qx = std::max(cx - JBU_RADIUS, 0); qx <= std::min(cx + JBU_RADIUS, low.width - 1); qx++) {
+                    const float diff = center - guides[qx];
+                    const float w = wy[qy - cy + JBU_RADIUS] * wx[qx - cx + JBU_RADIUS] * std::exp(diff * diff * range_coefficient);
+                    sum += w * values[qx];
+                    k += w;
+                }
+            }
+            // All range weights can underflow next to extreme outliers; fall back to the nearest sample.
+            result.row(y)[x] = k > 0.0f ? sum / k : low.at(cx, cy);
+        }
+    }
+    return result;
+}
+
+/// <summary>
+/// Bilateral filter computed on H downsampled by `factor` and upsampled with joint bilateral upsampling;
+/// same parameters as bilateralFilter (factor 1 is the exact filter).
+/// </summary>
+ImageFloat bilateralFilterSubsampled(const ImageFloatView H, const int size, const float space_sigma, const float range_sigma, const int factor)
+{
+    assert(size % 2 == 1 && factor >= 1);
+    if (factor == 1)
+        return bilateralFilterSimd(H, size, space_sigma, range_sigma);
+
+    const ImageFloat low = downsampleBox(H, factor);
+    const int low_size = std::max(1, size / factor) | 1;
+    const ImageFloat low_filtered = bilateralFilterSimd(low, low_size, space_sigma / float(factor), range_sigma);
+    return jointBilateralUpsample(low_filtered, low, H, factor, range_sigma);
+}
@@ -0,0 +1,148 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+#include "helpers.h"
+
+/*
+ * Domain-transform edge-aware filter, recursive-filtering variant (Gastal & Oliveira 2011).
+ *
+ * Every row (column) is warped by the domain transform ct(x) = integral of 1 + space_sigma / range_sigma * |I'|,
+ * with I the guide (sum of the absolute channel differences for RGB guides). Distances between neighbours are
+ * then d = 1 + space_sigma / range_sigma * |I(x) - I(x - 1)|, large across edges, and a first-order recursive
+ * filter with feedback a^d (a = exp(-sqrt(2) / sigma_i)) runs left to right and right to left on the warped
+ * signal, then top to bottom and bottom to top. Iteration i of N uses
+ *   sigma_i = space_sigma * sqrt(3) * 2^(N - i) / sqrt(4^N - 1),
+ * so that the variances of the N passes add up to space_sigma^2.
+ *
+ * Each pass is O(1) per pixel; the cost does not depend on the filter size. Vertical passes run row after row
+ * over strips of columns, so their inner loops vectorize across columns.
+ */
+
+/** Columns per task of the vertical passes. */
+constexpr int DOMAIN_TRANSFORM_COLUMN_STRIP = 256;
+
+inline float domainTransformDistance(const float a, const float b) { return std::abs(a - b); }
+inline float domainTransformDistance(const glm::vec3& a, const glm::vec3& b)
+{
+    return std::abs(a.x - b.x) + std::abs(a.y - b.y) + std::abs(a.z - b.z);
+}
+
+/**
+ * Derivatives of the domain transform: horizontal.at(x, y) between pixels x - 1 and x, vertical.at(x, y) between
+ * rows y - 1 and y (entries at x = 0 and y = 0 are unused).
+ */
+template <typename GuideT>
+void domainTransformDerivatives(const ImageView<GuideT>& guide, const float space_sigma, const float range_sigma, ImageFloat& horizontal, ImageFloat& vertical)
+{
+    const float ratio = space_sigma / range_sigma;
+    horizontal = ImageFloat(guide.width, guide.height, {}, ImageInit::Uninitialized);
+    vertical = ImageFloat(guide.width, guide.height, {}, ImageInit::Uninitialized);
+    #pragma omp parallel for
+    for (int y = 0; y < guide.height; y++) {
+        const GuideT* row = guide.row(y);
+        const GuideT* above = guide.row(std::max(y - 1, 0));
+        float* dx = horizontal.row(y);
+        float* dy = vertical.row(y);
+        dx[0] = 1.0f;
+        for (int x = 1; x < guide.width; x++)
+            dx[x] = 1.0f + ratio * domainTransformDistance(row[x], row[x - 1]);
+        for (int x = 0; x < guide.width; x++)
+            dy[x] = 1.0f + ratio * domainTransformDistance(row[x], above[x]);
+    }
+}
+
+/** One horizontal recursive pass (both directions) of every row with feedback a^d, in place. */
+inline void domainTransformHorizontalPass(ImageFloat& image, const ImageFloat& distances, const float a)
+{
+    const float log_a = std::log(a);
+    #pragma omp parallel
+    {
+        std::vector<float> weights(image.width);
+        #pragma omp for
+        for (int y = 0; y < image.height; y++) {
+            float* row = image.row(y);
+            const float* d = distances.row(y);
+            #pragma omp simd
+            for (int x = 0; x < image.width; x++)
+                weights[x] = std::exp(d[x] * log_a);
+            for (int x = 1; x < image.width; x++)
+                row[x] += weights[x] * (row[x - 1] - row[x]);
+            for (int x = image.width - 2; x >= 0; x--)
+                row[x] += weights[x + 1] * (row[x + 1] - row[x]);
+        }
+    }
+}
+
+/** One vertical recursive pass (both directions) of every column with feedback a^d, in place. */
+inline void domainTransformVerticalPass(ImageFloat& image, const ImageFloat& distances, const float a)
+{
+    const float log_a = std::log(a);
+    // Weights are computed once for all rows; the backward sweep reuses them.
+    ImageFloat weights(image.width, image.height, {}, ImageInit::Uninitialized);
+    const int strips = (image.width + DOMAIN_TRANSFORM_COLUMN_STRIP - 1) / DOMAIN_TRANSFORM_COLUMN_STRIP;
+    #pragma omp parallel for
+    for (int strip = 0; strip < strips; strip++) {
+        const int x0 = strip * DOMAIN_TRANSFORM_COLUMN_STRIP;
+        const int x1 = std::min(x0 + DOMAIN_TRANSFORM_COLUMN_STRIP, image.width);
+        for (int y = 1; y < image.height; y++) {
+            const float* d = distances.row(y);
+            const float* above = image.row(y - 1);
+            float* w = weights.row(y);
+            float* row = image.row(y);
+            #pragma omp simd
+            for (int x = x0; x < x1; x++) {
+                w[x] = std::exp(d[x] * log_a);
+                row[x] += w[x] * (above[x] - row[x]);
+            }
+        }
+        for (int y = image.height - 2; y >= 0; y--) {
+            const float* w = weights.row(y + 1);
+            const float* below = image.row(y + 1);
+            float* row = image.row(y);
+            #pragma omp simd
+            for (int x = x0; x < x1; x++)
+                row[x] += w[x] * (below[x] - row[x]);
+        }
+    }
+}
+
+/// <summary>
+/// Domain-transform recursive filter of H with an edge guide of the same size (ImageFloat or ImageRGB).
+/// </summary>
+/// <param name="space_sigma">spatial standard deviation in pixels</param>
+/// <param name="range_sigma">range standard deviation in guide units</param>
+/// <param name="iterations">number of horizontal + vertical pass pairs (3 is usually enough)</param>
+template <typename GuideT>
+ImageFloat domainTransformFilter(const ImageFloatView H, const ImageView<GuideT>& guide, const float space_sigma, const float range_sigma, const int iterations = 3)
+{
+    assert(H.width == guide.width && H.height == guide.height && iterations >= 1);
+    ImageFloat horizontal, vertical;
+    domainTransformDerivatives(guide, space_sigma, range_sigma, horizontal, vertical);
+
+    ImageFloat result(H);
+    for (int i = 0; i < iterations; i++) {
+        const float sigma_i = space_sigma * std::sqrt(3.0f) * std::pow(2.0f, float(iterations - i - 1)) / std::sqrt(std::pow(4.0f, float(iterations)) - 1.0f);
+        const float a = std::exp(-std::sqrt(2.0f) / sigma_i);
+        domainTransformHorizontalPass(result, horizontal, a);
+        domainTransformVerticalPass(result, vertical, a);
+    }
+    return result;
+}
+
+template <typename GuideT>
+ImageFloat domainTransformFilter(const ImageFloatView H, const Image<GuideT>& guide, const float space_sigma, const float range_sigma, const int iterations = 3)
+{
+    return domainTransformFilter(H, guide.view(), space_sigma, range_sigma, iterations);
+}
+
+/// <summary>
+/// Domain-transform recursive filter of H guided by itself; same parameters as bilateralFilter except the window
+/// size, which the recursive filter does not need.
+/// </summary>
+ImageFloat domainTransformFilter(const ImageFloatView H, const float space_sigma, const float range_sigma, const int iterations = 3)
+{
+    return domainTransformFilter(H, H, space_sigma, range_sigma, iterations);
+}
@@ -0,0 +1,145 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include <framework/fft.h>
+
+#include "helpers.h"
+
+/*
+ * Piecewise-linear fast bilateral filter (Durand & Dorsey 2002, section 5).
+ *
+ * The intensity range is sampled at NB = ceil((max - min) / range_sigma) + 1 levels i_j. For every level the
+ * range weights G_j = g_r(i_j - I) and the weighted intensities G_j * I are convolved with the spatial Gaussian
+ * (FFT convolution, kernel size x size), giving J_j = (G_j * I conv f) / (G_j conv f). The output at a pixel is
+ * the linear interpolation of the two J_j around its intensity.
+ *
+ * The subsampled variant computes the J_j on an image box-downsampled by `subsampling` (spatial sigma and
+ * kernel scaled accordingly) and upsamples them bilinearly; the interpolation weights still use the
+ * full-resolution intensities, so edges stay sharp.
+ *
+ * Pixels outside the image are zero in both convolutions, which crops the kernel at the borders like the
+ * reference. Cost: 2 NB FFT convolutions, independent of the kernel size.
+ */
+
+/** Normalized-free Gaussian kernel exp(-d^2 / (2 sigma^2)) of size x size. */
+inline ImageFloat gaussianKernelImage(const int size, const float sigma)
+{
+    const int radius = size / 2;
+    ImageFloat kernel(size, size);
+    for (int y = 0; y < size; y++)
+        for (int x = 0; x < size; x++)
+            kernel.row(y)[x] = std::exp(-float((x - radius) * (x - radius) + (y - radius) * (y - radius)) / (2.0f * sigma * sigma));
+    return kernel;
+}
+
+/** Box-filtered downsampling by an integer factor (partial blocks at the borders are averaged over their pixels). */
+inline ImageFloat downsampleBox(const ImageFloatView image, const int factor)
+{
+    const int w = (image.width + factor - 1) / factor;
+    const int h = (image.height + factor - 1) / factor;
+    ImageFloat result(w, h, {}, ImageInit::Uninitialized);
+    #pragma omp parallel for
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            float sum = 0.0f;
+            int count = 0;
+            for (int sy = y * factor; sy < std::min((y + 1) * factor, image.height); sy++)
+                for (int sx = x * factor; sx < std::min((x + 1) * factor, image.width); sx++, count++)
+                    sum += image.at(sx, sy);
+            result.row(y)[x] = sum / float(count);
+        }
+    }
+    return result;
+}
+
+/** Bilinear sample of a low-resolution image at the full-resolution pixel (x, y) for a downsampling factor. */
+inline float sampleUpsampled(const ImageFloatView low, const int x, const int y, const int factor)
+{
+    // Low-resolution pixel centers sit at (i + 0.5) * factor - 0.5 in full-resolution coordinates.
+    const float lx = std::clamp((float(x) + 0.5f) / float(factor) - 0.5f, 0.0f, float(low.width - 1));
+    const float ly = std::clamp((float(y) + 0.5f) / float(factor) - 0.5f, 0.0f, float(low.height - 1));
+    const int x0 = std::min(int(lx), low.width - 1), y0 = std::min(int(ly), low.height - 1);
+    const int x1 = std::min(x0 + 1, low.width - 1), y1 = std::min(y0 + 1, low.height - 1);
+    const float fx = lx - float(x0), fy = ly - float(y0);
+    const float top = low.at(x0, y0) + fx * (low.at(x1, y0) - low.at(x0, y0));
+    const float bottom = low.at(x0, y1) + fx * (low.at(x1, y1) - low.at(x0, y1));
+    return top + fy * (bottom - top);
+}
+
+/// <summary>
+/// Durand-Dorsey piecewise-linear bilateral filter; same signature as bilateralFilter plus the subsampling factor
+/// (1 = full resolution).
+/// </summary>
+ImageFloat fastBilateralFilter(const ImageFloatView H, const int size, const float space_sigma, const float range_sigma, const int subsampling = 1)
+{
+    assert(size % 2 == 1 && subsampling >= 1);
+
+    float min_value = std::numeric_limits<float>::max();
+    float max_value = std::numeric_limits<float>::lowest();
+    #pragma omp parallel for reduction(min : min_value) reduction(max : max_value)
+    for (int y = 0; y < H.height; y++) {
+        for (int x = 0; x < H.width; x++) {
+            min_value = std::min(min_value, H.at(x, y));
+            max_value = std::max(max_value, H.at(x, y));
+        }
+    }
+    // A flat (or empty) image is its own bilateral filter. The hat weights below also need the levels to be
+    // distinct floats, which they are not when the range is below float resolution.
+    if (!(max_value > min_value))
+        return ImageFloat(H);
+    const int num_levels = std::max(2, int(std::ceil((max_value - min_value) / range_sigma)) + 1);
+    const float level_step = (max_value - min_value) / float(num_levels - 1);
+    if (!(min_value + level_step > min_value && max_value - level_step < max_value))
+        return ImageFloat(H);
+
+    // Intensities the per-level results are computed on (full or subsampled resolution).
+    const ImageFloat low = subsampling > 1 ? downsampleBox(H, subsampling) : ImageFloat(H);
+    const int low_size = std::max(1, size / subsampling) | 1;
+    const FFTConvolver convolver(low.width, low.height, gaussianKernelImage(low_size, space_sigma / float(subsampling)));
+
+    ImageFloat result(H.width, H.height);
+    ImageFloat weights(low.width, low.height, {}, ImageInit::Uninitialized); // G_j
+    ImageFloat weighted(low.width, low.height, {}, ImageInit::Uninitialized); // G_j * I
+    const float range_coefficient = -1.0f / (2.0f * range_sigma * range_sigma);
+
+    for (int level = 0; level < num_levels; level++) {
+        const float level_value = min_value + float(level) * level_step;
+
+        #pragma omp parallel for
+        for (int y = 0; y < low.height; y++) {
+            for (int x = 0; x < low.width; x++) {
+                const float value = low.at(x, y);
+                const float diff = level_value - value;
+                const float g = std::exp(diff * diff * range_coefficient);
+                weights.row(y)[x] = g;
+                weighted.row(y)[x] = g * value;
+            }
+        }
+
+        // J_j = (G_j I conv f) / (G_j conv f).
+        const ImageFloat k = convolver.convolve(weights);
+        ImageFloat j = convolver.convolve(weighted);
+        #pragma omp parallel for
+        for (int y = 0; y < low.height; y++)
+            for (int x = 0; x < low.width; x++)
+                j.row(y)[x] = k.at(x, y) > 1e-20f ? j.at(x, y) / k.at(x, y) : level_value;
+
+        // Add the level with the hat weight of every full-resolution pixel around it.
+        #pragma omp parallel for
+        for (int y = 0; y < H.height; y++) {
+            float* dst = result.row(y);
+            const float* src = H.row(y);
+            for (int x = 0; x < H.width; x++) {
+                const float hat = 1.0f - std::abs(src[x] - level_value) / level_step;
+                if (hat > 0.0f)
+                    dst[x] += hat * (subsampling > 1 ? sampleUpsampled(j, x, y, subsampling) : j.at(x, y));
+            }
+        }
+    }
+
+    return result;
+}
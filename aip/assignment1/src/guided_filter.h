@@ -0,0 +1,74 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+
+#include <framework/summed_area_table.h>
+
+#include "helpers.h"
+
+/*
+ * Guided filter (He, Sun & Tang 2010) with a scalar guide.
+ *
+ * In every (2 radius + 1)^2 window w the output is a linear function of the guide, q = a_w I + b_w, with
+ *   a_w = cov_w(I, p) / (var_w(I) + epsilon),  b_w = mean_w(p) - a_w mean_w(I),
+ * and the output at a pixel averages the models of all windows covering it: q = mean(a) I + mean(b).
+ * Windows with a variance well above epsilon keep their edges (a ~ 1), flat ones are averaged (a ~ 0); unlike the
+ * bilateral filter the output stays a local linear transform of the guide, so it has no gradient reversal.
+ *
+ * All box means come from summed-area tables (double accumulation), so the cost does not depend on the radius.
+ * Windows are clipped at the image borders.
+ */
+
+/// <summary>
+/// Guided filter of `input` with guide `guide` (same size).
+/// </summary>
+/// <param name="radius">window radius in pixels</param>
+/// <param name="epsilon">regularization, in squared intensity units (edges with a variance below it are smoothed)</param>
+ImageFloat guidedFilter(const ImageFloatView guide, const ImageFloatView input, const int radius, const float epsilon)
+{
+    assert(guide.width == input.width && guide.height == input.height);
+    const int width = guide.width, height = guide.height;
+
+    ImageFloat guide_squared(width, height, {}, ImageInit::Uninitialized);
+    ImageFloat guide_input(width, height, {}, ImageInit::Uninitialized);
+    #pragma omp parallel for
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            const float i = guide.at(x, y);
+            guide_squared.row(y)[x] = i * i;
+            guide_input.row(y)[x] = i * input.at(x, y);
+        }
+    }
+
+    const SummedAreaTable<float> sum_i(guide), sum_p(input), sum_ii(guide_squared), sum_ip(guide_input);
+    ImageFloat a(width, height, {}, ImageInit::Uninitialized);
+    ImageFloat b(width, height, {}, ImageInit::Uninitialized);
+    #pragma omp parallel for
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            const double mean_i = sum_i.boxMean(x, y, radius);
+            const double mean_p = sum_p.boxMean(x, y, radius);
+            const double variance = sum_ii.boxMean(x, y, radius) - mean_i * mean_i;
+            const double covariance = sum_ip.boxMean(x, y, radius) - mean_i * mean_p;
+            const double slope = covariance / (std::max(variance, 0.0) + epsilon);
+            a.row(y)[x] = float(slope);
+            b.row(y)[x] = float(mean_p - slope * mean_i);
+        }
+    }
+
+    const SummedAreaTable<float> sum_a(a), sum_b(b);
+    ImageFloat result(width, height, {}, ImageInit::Uninitialized);
+    #pragma omp parallel for
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+            result.row(y)[x] = float(sum_a.boxMean(x, y, radius) * guide.at(x, y) + sum_b.boxMean(x, y, radius));
+    return result;
+}
+
+/// <summary>
+/// Edge-preserving smoothing of H guided by itself, as a base-layer alternative to bilateralFilter.
+/// </summary>
+ImageFloat guidedFilter(const ImageFloatView H, const int radius, const float epsilon)
+{
+    return guidedFilter(H, H, radius, epsilon);
+}
@@ -27,7 +27,10 @@ DISABLE_WARNINGS_POP()
 #include <omp.h>
 #endif
 
+#include <framework/gaussian_blur.h>
 #include <framework/image.h>
+#include <framework/image_pool.h>
+#include <framework/tiled_image.h>
 
 /// <summary>
 /// Structure of an image with 3 planes.
@@ -65,6 +68,27 @@ struct ImagePlane3 {
             throw std::out_of_range("Index out of range");
         }
     }
+
+    /// <summary>
+    /// Stores all planes in a single image file (3 planes for images, 6 for gradients).
+    /// </summary>
+    void saveBinary(const std::filesystem::path& filePath) const
+    {
+        std::vector<ImageView<float>> planes;
+        for (size_t i = 0; i < 3; i++) {
+            appendPlaneViews(planes, (*this)[i]);
+        }
+        writeImageFile<float>(filePath, planes);
+    }
+
+    void readBinary(const std::filesystem::path& filePath)
+    {
+        auto planes = readImageFilePlanes<float>(filePath);
+        auto next = planes.begin();
+        for (size_t i = 0; i < 3; i++) {
+            takePlanes(next, planes.end(), (*this)[i]);
+        }
+    }
 };
 
 
@@ -74,29 +98,101 @@ using ImageFloat = Image<float>;
 using ImageVec3 = Image<glm::vec3>;
 /// <summary> 3-channel image stored in plane order </summary>
 using ImageFloatPlane3 = ImagePlane3<ImageFloat>;
+/// <summary> 3-channel image stored in attribute order, padded to 16 bytes per pixel (w unused) </summary>
+using ImageVec4 = Image<glm::vec4>;
 
 /// <summary> Image in RGB colorspace </summary>
 using ImageRGB = ImageVec3;
+/// <summary> Image in RGB colorspace with SIMD-friendly 16-byte pixels </summary>
+using ImageRGBPadded = ImageVec4;
 /// <summary> Image in XYZ colorspace </summary>
 using ImageXYZ = ImageFloatPlane3;
 
+/// <summary> Scalar image stored as 16-bit floats (computed in float) </summary>
+using ImageHalf = Image<half>;
+/// <summary> Scalar 8-bit image, e.g. a mask (v / 255, computed in float) </summary>
+using ImageMask8 = Image<uint8_t>;
+/// <summary> 8-bit RGB image, e.g. a display-ready result (v / 255, computed in vec3) </summary>
+using ImageRGB8 = Image<glm::u8vec3>;
+
+/// <summary> Read-only, non-owning view of a scalar image (or of its ROI) </summary>
+using ImageFloatView = ImageView<float>;
+/// <summary> Read-only, non-owning view of an RGB image (or of its ROI) </summary>
+using ImageRGBView = ImageView<glm::vec3>;
+/// <summary> Writable, non-owning view of a scalar image (or of its ROI) </summary>
+using MutableImageFloatView = MutableImageView<float>;
+/// <summary> Writable, non-owning view of an RGB image (or of its ROI) </summary>
+using MutableImageRGBView = MutableImageView<glm::vec3>;
+/// <summary> Scalar image stored in square tiles, for stencils run tile by tile </summary>
+using TiledImageFloat = TiledImage<float>;
+
 
 /// <summary> Gradient of a scalar image </summary>
 struct ImageGradient {
     ImageFloat dx;
     ImageFloat dy;
 
-    void saveBinary(const std::filesystem::path& basePath) {
-        dx.saveBinary(basePath.string() + "_dx.bin");
-        dy.saveBinary(basePath.string() + "_dy.bin");
+    /// <summary>
+    /// Stores dx and dy as two planes of the single image file "basePath.bin".
+    /// </summary>
+    void saveBinary(const std::filesystem::path& basePath) const {
+        const ImageView<float> planes[] = { dx.view(), dy.view() };
+        writeImageFile<float>(filePath(basePath), planes);
     }
 
+    /// <summary>
+    /// Reads "basePath.bin", or the legacy pair "basePath_dx.bin" and "basePath_dy.bin".
+    /// </summary>
     void readBinary(const std::filesystem::path& basePath) {
-        dx.readBinary(basePath.string() + "_dx.bin");
-        dy.readBinary(basePath.string() + "_dy.bin");
+        if (std::filesystem::exists(basePath.string() + "_dx.bin")) {
+            dx.readBinary(basePath.string() + "_dx.bin");
+            dy.readBinary(basePath.string() + "_dy.bin");
+            return;
+        }
+        auto planes = readImageFilePlanes<float>(filePath(basePath));
+        dx = std::move(planes.at(0));
+        dy = std::move(planes.at(1));
+    }
+
+private:
+    static std::filesystem::path filePath(const std::filesystem::path& basePath) {
+        return basePath.extension() == ".bin" ? basePath : std::filesystem::path(basePath.string() + ".bin");
     }
 };
 
+/// <summary>
+/// Collects the scalar planes of an image / a gradient (in storage order) for multi-plane image files.
+/// </summary>
+void appendPlaneViews(std::vector<ImageView<float>>& planes, const ImageFloat& image)
+{
+    planes.push_back(image.view());
+}
+
+void appendPlaneViews(std::vector<ImageView<float>>& planes, const ImageGradient& gradient)
+{
+    planes.push_back(gradient.dx.view());
+    planes.push_back(gradient.dy.view());
+}
+
+/// <summary>
+/// Moves planes read from a multi-plane image file into an image / a gradient (inverse of appendPlaneViews).
+/// </summary>
+template <typename It>
+void takePlanes(It& next, const It end, ImageFloat& image)
+{
+    if (next == end) {
+        throw std::out_of_range("Not enough planes in the image file");
+    }
+    image = std::move(*next++);
+}
+
+template <typename It>
+void takePlanes(It& next, const It end, ImageGradient& gradient)
+{
+    takePlanes(next, end, gradient.dx);
+    takePlanes(next, end, gradient.dy);
+}
+
 /// <summary> Gradient of a XYZ image (contains one dxy-gradient image per channel) </summary>
 using ImageXYZGradient = ImagePlane3<ImageGradient>;
 
@@ -124,10 +220,15 @@ void printOpenMPStatus()
 /// <param name="gradient"></param>
 /// <returns></returns>
 ImageRGB gradientsToRgb(const ImageGradient& gradient) {
-    auto grad_rgb = ImageRGB(gradient.dx.width, gradient.dx.height);
+    auto grad_rgb = ImageRGB(gradient.dx.width, gradient.dx.height, {}, ImageInit::Uninitialized);
     #pragma omp parallel for
-    for (auto i = 0; i < grad_rgb.data.size(); i++) {
-        grad_rgb.data[i] = glm::abs(glm::vec3(gradient.dx.data[i], gradient.dy.data[i], 0.0f));
+    for (int y = 0; y < grad_rgb.height; y++) {
+        const auto* dx = gradient.dx.row(y);
+        const auto* dy = gradient.dy.row(y);
+        auto* dst = grad_rgb.row(y);
+        for (int x = 0; x < grad_rgb.width; x++) {
+            dst[x] = glm::abs(glm::vec3(dx[x], dy[x], 0.0f));
+        }
     }
     return grad_rgb;
 }
@@ -138,11 +239,15 @@ ImageRGB gradientsToRgb(const ImageGradient& gradient) {
 /// </summary>
 /// <param name="img"></param>
 /// <returns></returns>
-ImageRGB imageFloatToRgb(const ImageFloat& img) {
-    auto result = ImageRGB(img.width, img.height);
+ImageRGB imageFloatToRgb(const ImageFloatView img) {
+    auto result = ImageRGB(img.width, img.height, {}, ImageInit::Uninitialized);
     #pragma omp parallel for
-    for (int i = 0; i < result.data.size(); i++) {
-        result.data[i] = glm::vec3(img.data[i], img.data[i], img.data[i]);
+    for (int y = 0; y < img.height; y++) {
+        const auto* src = img.row(y);
+        auto* dst = result.row(y);
+        for (int x = 0; x < img.width; x++) {
+            dst[x] = glm::vec3(src[x], src[x], src[x]);
+        }
     }
     return result;
 }
@@ -152,43 +257,127 @@ ImageRGB imageFloatToRgb(const ImageFloat& img) {
 /// </summary>
 /// <param name="img"></param>
 /// <returns></returns>
-ImageFloat imageRgbToFloat(const ImageRGB& img)
+ImageFloat imageRgbToFloat(const ImageRGBView img)
 {
-    auto result = ImageFloat(img.width, img.height);
+    auto result = ImageFloat(img.width, img.height, {}, ImageInit::Uninitialized);
 #pragma omp parallel for
-    for (int i = 0; i < result.data.size(); i++) {
-        result.data[i] = img.data[i].x;
+    for (int y = 0; y < img.height; y++) {
+        const auto* src = img.row(y);
+        auto* dst = result.row(y);
+        for (int x = 0; x < img.width; x++) {
+            dst[x] = src[x].x;
+        }
     }
     return result;
 }
 
 
 
+/// <summary>
+/// Converts a 12-byte RGB image to the vec4-padded layout (w = 0).
+/// </summary>
+/// <param name="img"></param>
+/// <param name="layout">layout of the result, rows padded to cache lines by default</param>
+/// <returns></returns>
+ImageRGBPadded imageRgbToPadded(const ImageRGBView img, const ImageLayout& layout = ImageLayout::padded())
+{
+    auto result = ImageRGBPadded(img.width, img.height, layout, ImageInit::Uninitialized);
+#pragma omp parallel for
+    for (int y = 0; y < img.height; y++) {
+        const auto* src = img.row(y);
+        auto* dst = result.row(y);
+        for (int x = 0; x < img.width; x++) {
+            dst[x] = glm::vec4(src[x], 0.0f);
+        }
+    }
+    return result;
+}
+
+/// <summary>
+/// Converts a vec4-padded RGB image back to the packed 12-byte layout.
+/// </summary>
+/// <param name="img"></param>
+/// <returns></returns>
+ImageRGB imagePaddedToRgb(const ImageView<glm::vec4> img)
+{
+    auto result = ImageRGB(img.width, img.height, {}, ImageInit::Uninitialized);
+#pragma omp parallel for
+    for (int y = 0; y < img.height; y++) {
+        const auto* src = img.row(y);
+        auto* dst = result.row(y);
+        for (int x = 0; x < img.width; x++) {
+            dst[x] = glm::vec3(src[x].x, src[x].y, src[x].z);
+        }
+    }
+    return result;
+}
+
 /// <summary>
 /// Compute natural log of image.
 /// </summary>
 /// <param name="image"></param>
 /// <returns></returns>
-ImageFloat logImage(const ImageFloat& image)
+ImageFloat logImage(const ImageFloatView image)
 {
-    auto result = ImageFloat(image.width, image.height);
+    auto result = ImageFloat(image.width, image.height, {}, ImageInit::Uninitialized);
 #pragma omp parallel for
-    for (int i = 0; i < image.data.size(); i++) {
-        result.data[i] = logf(std::max(image.data[i], 1e-8f));
+    for (int y = 0; y < image.height; y++) {
+        const auto* src = image.row(y);
+        auto* dst = result.row(y);
+        for (int x = 0; x < image.width; x++) {
+            dst[x] = logf(std::max(src[x], 1e-8f));
+        }
     }
     return result;
 }
 
-ImageFloat logToLinear(const ImageFloat& image)
+/// <summary>
+/// Lazy variants of logImage() and logToLinear() for expressions (see framework/image_expr.h),
+/// evaluated together with the rest of the expression in one pass.
+/// </summary>
+template <typename E>
+auto logImage(const ImageExpr<E>& expr)
+{
+    return lazyLog(expr.derived(), 1e-8f);
+}
+
+template <typename E>
+auto logToLinear(const ImageExpr<E>& expr)
 {
-    auto result = ImageFloat(image.width, image.height);
+    return lazyExp(expr.derived());
+}
+
+ImageFloat logToLinear(const ImageFloatView image)
+{
+    auto result = ImageFloat(image.width, image.height, {}, ImageInit::Uninitialized);
 #pragma omp parallel for
-    for (int i = 0; i < image.data.size(); i++) {
-        result.data[i] = std::exp(image.data[i]);
+    for (int y = 0; y < image.height; y++) {
+        const auto* src = image.row(y);
+        auto* dst = result.row(y);
+        for (int x = 0; x < image.width; x++) {
+            dst[x] = std::exp(src[x]);
+        }
     }
     return result;
 }
 
+/// <summary>
+/// Converts a temporary from log to linear space in place, reusing its buffer.
+/// </summary>
+/// <param name="image"></param>
+/// <returns></returns>
+ImageFloat logToLinear(ImageFloat&& image)
+{
+#pragma omp parallel for
+    for (int y = 0; y < image.height; y++) {
+        auto* row = image.row(y);
+        for (int x = 0; x < image.width; x++) {
+            row[x] = std::exp(row[x]);
+        }
+    }
+    return std::move(image);
+}
+
 
 
 /// <summary>
@@ -198,13 +387,18 @@ ImageFloat logToLinear(const ImageFloat& image)
 /// <param name="H"></param>
 /// <param name="base"></param>
 /// <returns></returns>
-ImageFloat getDetailImage(const ImageFloat& H, const ImageFloat& base)
+ImageFloat getDetailImage(const ImageFloatView H, const ImageFloatView base)
 {
     // Empty output image.
-    auto result = ImageFloat(H.width, H.height);
+    auto result = ImageFloat(H.width, H.height, {}, ImageInit::Uninitialized);
 #pragma omp parallel for
-    for (int i = 0; i < result.data.size(); i++) {
-        result.data[i] = H.data[i] - base.data[i];
+    for (int y = 0; y < H.height; y++) {
+        const auto* h = H.row(y);
+        const auto* b = base.row(y);
+        auto* dst = result.row(y);
+        for (int x = 0; x < H.width; x++) {
+            dst[x] = h[x] - b[x];
+        }
     }
     return result;
 }
@@ -221,18 +415,21 @@ Unused code.
 /// </summary>
 /// <param name="rgb"></param>
 /// <returns></returns>
-ImageXYZ rgbToXYZ(const ImageRGB& rgb)
+ImageXYZ rgbToXYZ(const ImageRGBView rgb)
 {
-    auto xyz = ImageXYZ(ImageFloat(rgb.width, rgb.height), ImageFloat(rgb.width, rgb.height), ImageFloat(rgb.width, rgb.height));
+    auto xyz = ImageXYZ(ImageFloat(rgb.width, rgb.height, {}, ImageInit::Uninitialized), ImageFloat(rgb.width, rgb.height, {}, ImageInit::Uninitialized), ImageFloat(rgb.width, rgb.height, {}, ImageInit::Uninitialized));
 
     const auto MAT_RGB_TO_XYZ = glm::transpose(glm::mat3(0.49f, 0.31f, 0.2f, 0.17697f, 0.8124f, 0.01063f, 0.0f, 0.01f, 0.99000f));
 
 #pragma omp parallel for
-    for (int i = 0; i < rgb.data.size(); i++) {
-        auto v = MAT_RGB_TO_XYZ * rgb.data[i];
-        xyz.X.data[i] = v.x;
-        xyz.Y.data[i] = v.y;
-        xyz.Z.data[i] = v.z;
+    for (int y = 0; y < rgb.height; y++) {
+        const auto* src = rgb.row(y);
+        for (int x = 0; x < rgb.width; x++) {
+            auto v = MAT_RGB_TO_XYZ * src[x];
+            xyz.X.row(y)[x] = v.x;
+            xyz.Y.row(y)[x] = v.y;
+            xyz.Z.row(y)[x] = v.z;
+        }
     }
 
     return xyz;
@@ -245,16 +442,17 @@ ImageXYZ rgbToXYZ(const ImageRGB& rgb)
 /// <returns></returns>
 ImageRGB xyzToRGB(const ImageXYZ& xyz)
 {
-    auto rgb = ImageRGB(xyz.X.width, xyz.X.height);
+    auto rgb = ImageRGB(xyz.X.width, xyz.X.height, {}, ImageInit::Uninitialized);
 
     const auto MAT_RGB_TO_XYZ = glm::transpose(glm::mat3(0.49f, 0.31f, 0.2f, 0.17697f, 0.8124f, 0.01063f, 0.0f, 0.01f, 0.99000f));
     const auto MAT_XYZ_TO_RGB = glm::inverse(MAT_RGB_TO_XYZ);
 
 #pragma omp parallel for
-    for (int i = 0; i < xyz.X.data.size(); i++) {
-        auto v = glm::vec3(xyz.X.data[i], xyz.Y.data[i], xyz.Z.data[i]);
-        auto xyz = MAT_XYZ_TO_RGB * v;
-        rgb.data[i] = xyz;
+    for (int y = 0; y < rgb.height; y++) {
+        auto* dst = rgb.row(y);
+        for (int x = 0; x < rgb.width; x++) {
+            dst[x] = MAT_XYZ_TO_RGB * glm::vec3(xyz.X.row(y)[x], xyz.Y.row(y)[x], xyz.Z.row(y)[x]);
+        }
     }
 
     return rgb;
@@ -266,13 +464,16 @@ ImageRGB xyzToRGB(const ImageXYZ& xyz)
 /// </summary>
 /// <param name="image">image in attribute order</param>
 /// <returns>image in plane order</returns>
-ImageFloatPlane3 imageVec3ToPlane3(const ImageVec3& image)
+ImageFloatPlane3 imageVec3ToPlane3(const ImageView<glm::vec3> image)
 {
     auto result = ImageFloatPlane3({ image.width, image.height }, { image.width, image.height }, { image.width, image.height });
 #pragma omp parallel for
-    for (int i = 0; i < image.data.size(); i++) {
-        for (auto j = 0; j < 3; j++) {
-            result[j].data[i] = image.data[i][j];
+    for (int y = 0; y < image.height; y++) {
+        const auto* src = image.row(y);
+        for (int x = 0; x < image.width; x++) {
+            for (auto j = 0; j < 3; j++) {
+                result[j].row(y)[x] = src[x][j];
+            }
         }
     }
     return result;
@@ -285,14 +486,23 @@ ImageFloatPlane3 imageVec3ToPlane3(const ImageVec3& image)
 /// <returns>image in plane order</returns>
 ImageVec3 imagePlane3ToVec3(const ImageFloatPlane3& image)
 {
-    auto result = ImageVec3(image.X.width, image.X.height);
+    auto result = ImageVec3(image.X.width, image.X.height, {}, ImageInit::Uninitialized);
 #pragma omp parallel for
-    for (int i = 0; i < image.X.data.size(); i++) {
-        for (auto j = 0; j < 3; j++) {
-            result.data[i][j] = image[j].data[i];
+    for (int y = 0; y < result.height; y++) {
+        auto* dst = result.row(y);
+        for (int x = 0; x < result.width; x++) {
+            for (auto j = 0; j < 3; j++) {
+                dst[x][j] = image[j].row(y)[x];
+            }
         }
     }
     return result;
 }
 
-
+/// <summary>
+/// Gaussian blur of every plane (see framework/gaussian_blur.h for the methods).
+/// </summary>
+ImageFloatPlane3 gaussianBlur(const ImageFloatPlane3& image, const float sigma, const GaussianBlurMethod method = GaussianBlurMethod::Auto)
+{
+    return { gaussianBlur(image.X, sigma, method), gaussianBlur(image.Y, sigma, method), gaussianBlur(image.Z, sigma, method) };
+}
@@ -28,6 +28,9 @@ int main()
     std::chrono::steady_clock::time_point time_start, time_end;
     printOpenMPStatus();
 
+    // Recycles buffers of intermediates that are no longer needed.
+    ImagePool pool;
+
     #pragma region HDR TMO
     //////////////////////////////////////////////////////////////////////////////
     /// Part I: HDR Tone Mapping
@@ -60,7 +63,11 @@ int main()
     const int filter_size = 27; // must be an odd integer
     const float space_sigma = filter_size / 6.4f;
     const float range_sigma = 1.0f;
-    auto base_image = bilateralFilter(log_lum_H, filter_size, space_sigma, range_sigma);
+    // Exact vectorized kernel when the CPU has AVX2, otherwise the exact kernel fully unrolled for this fixed size
+    // (bilateralFilterFixed<13>). See BilateralBackend for the approximate alternatives (Grid, Permutohedral,
+    // PiecewiseLinear[Subsampled], DomainTransform) and the guided filter, whose cost does not grow with filter_size.
+    const auto bilateral_backend = bilateralSimdSupported() ? BilateralBackend::Simd : BilateralBackend::Fixed;
+    auto base_image = bilateralFilter(log_lum_H, filter_size, space_sigma, range_sigma, bilateral_backend);
     normalizeFloatImage(base_image).writeToFile(outDirPath / "4_base_layer.png");
 
     // [Provided] Get Detail image.
@@ -77,6 +84,13 @@ int main()
     auto tmo_rgb = rescaleRgbByLuminance(hdr_image, hdr_luminance, tmo_luminance);
     tmo_rgb.writeToFile(outDirPath / "7_tmo_rgb.png");
 
+    // The scalar TMO layers have the same shape as the Poisson solver buffers: recycle them.
+    pool.adopt(std::move(hdr_luminance));
+    pool.adopt(std::move(log_lum_H));
+    pool.adopt(std::move(base_image));
+    pool.adopt(std::move(detail_image));
+    pool.adopt(std::move(tmo_luminance));
+
     #pragma endregion HDR TMO
 
     #pragma region Poisson
@@ -85,7 +99,7 @@ int main()
     //////////////////////////////////////////////////////////////////////////////
 
     // [Provided]  Read Mask and source images
-    auto target_image = tmo_rgb;
+    auto target_image = std::move(tmo_rgb); // tmo_rgb is not used anymore, take over its buffer.
     auto source_image = ImageRGB(dataDirPath / "cat.png");
     auto source_mask = imageRgbToFloat(ImageRGB(dataDirPath / "cat_mask.png"));
 
@@ -120,7 +134,17 @@ int main()
     normalizeRGBImage(imagePlane3ToVec3(divergence_XYZ)).writeToFile(outDirPath / "10_divergence.png");
     
     // 11. Solve Poisson equations per channel (XYZ)
-    auto edit_result_XYZ = solvePoissonXYZ(target_image_XYZ, divergence_XYZ, 2000);
+    // Conjugate gradient preconditioned by a multigrid V-cycle until the relative residual is below 1e-6, on the
+    // pixels of the source mask only: the rest of the target is kept as is. See PoissonMethod for the
+    // alternatives; solvePoissonXYZ(target_image_XYZ, divergence_XYZ, 2000, &pool) runs the 2000 Jacobi iterations
+    // of the reference over the whole image.
+    const PoissonSettings poisson_settings {
+        .method = PoissonMethod::ConjugateGradient,
+        .progress = [](const PoissonReport& report) {
+            std::cout << "[" << report.iterations << "] Solving Poisson equation, relative residual " << report.relative_residual << std::endl;
+        },
+    };
+    auto edit_result_XYZ = solvePoissonXYZ(std::move(target_image_XYZ), divergence_XYZ, source_mask, poisson_settings, &pool);
     imagePlane3ToVec3(edit_result_XYZ).writeToFile(outDirPath / "11_edit_result_XYZ.png");
 
     // [Provided] 12. XYZ to RGB
@@ -130,6 +154,8 @@ int main()
 
     #pragma endregion Poisson
 
+    std::cout << "Image pool: " << pool.numAllocated() << " buffers allocated, " << pool.numReused() << " reused, peak "
+              << pool.peakBytesInUse() / (1024 * 1024) << " MiB in use." << std::endl;
     std::cout << "All done!" << std::endl;
     return 0;
 }
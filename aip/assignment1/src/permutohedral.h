@@ -0,0 +1,335 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "helpers.h"
+
+/*
+ * Permutohedral lattice (Adams, Baek & Davis 2010) for joint / cross bilateral filtering.
+ *
+ * Every pixel is a point in a d-dimensional feature space (x / space_sigma, y / space_sigma and the guide
+ * channels / range_sigma). Values are splatted onto the vertices of the enclosing simplex of the permutohedral
+ * lattice, blurred along the d + 1 lattice directions and sliced back with the same barycentric weights.
+ * The cost is linear in the number of pixels and grows only linearly with d, so RGB or XYZ guides are cheap.
+ * The result approximates a Gaussian joint bilateral filter without window truncation.
+ */
+
+class PermutohedralLattice {
+public:
+    /** position_dims = feature dimensions d, value_dims = values per point (including the homogeneous weight). */
+    PermutohedralLattice(const int position_dims, const int value_dims, const int num_points)
+        : d(position_dims)
+        , vd(value_dims)
+        , scale_factor(d)
+        , canonical(size_t(d + 1) * (d + 1))
+        , replay(size_t(num_points) * (d + 1))
+        , elevated(d + 1)
+        , greedy(d + 1)
+        , rank(d + 1)
+        , barycentric(d + 2)
+        , key(d)
+    {
+        // Scale so that the blur below corresponds to a Gaussian of standard deviation 1 in feature space.
+        const float inv_std_dev = std::sqrt(2.0f / 3.0f) * float(d + 1);
+        for (int i = 0; i < d; i++)
+            scale_factor[i] = inv_std_dev / std::sqrt(float((i + 1) * (i + 2)));
+
+        // Vertices of the canonical simplex: vertex r has coordinates r (d + 1 - r times) and r - (d + 1).
+        for (int r = 0; r <= d; r++) {
+            for (int j = 0; j <= d - r; j++)
+                canonical[size_t(r) * (d + 1) + j] = r;
+            for (int j = d - r + 1; j <= d; j++)
+                canonical[size_t(r) * (d + 1) + j] = r - (d + 1);
+        }
+
+        table_entries.assign(1024, -1);
+    }
+
+    /** Splats the value of point `index` at `position` (d features). Points must be splatted in order, serially. */
+    void splat(const int index, const float* position, const float* value)
+    {
+        // Project onto the hyperplane x_0 + ... + x_d = 0 of the (d + 1)-dimensional lattice space.
+        elevated[d] = -float(d) * position[d - 1] * scale_factor[d - 1];
+        for (int i = d - 1; i > 0; i--)
+            elevated[i] = elevated[i + 1] - float(i) * position[i - 1] * scale_factor[i - 1] + float(i + 2) * position[i] * scale_factor[i];
+        elevated[0] = elevated[1] + 2.0f * position[0] * scale_factor[0];
+
+        // Closest remainder-0 lattice point, found greedily and then moved back onto the hyperplane.
+        const float scale = 1.0f / float(d + 1);
+        int sum = 0;
+        for (int i = 0; i <= d; i++) {
+            const float v = elevated[i] * scale;
+            const float up = std::ceil(v) * float(d + 1);
+            const float down = std::floor(v) * float(d + 1);
+            greedy[i] = int(up - elevated[i] < elevated[i] - down ? up : down);
+            sum += greedy[i];
+        }
+        sum /= d + 1;
+
+        // Ranking of the differentials gives the permutation from this simplex to the canonical one.
+        std::fill(rank.begin(), rank.end(), 0);
+        for (int i = 0; i < d; i++) {
+            for (int j = i + 1; j <= d; j++) {
+                if (elevated[i] - float(greedy[i]) < elevated[j] - float(greedy[j]))
+                    rank[i]++;
+                else
+                    rank[j]++;
+            }
+        }
+        if (sum > 0) {
+            for (int i = 0; i <= d; i++) {
+                if (rank[i] >= d + 1 - sum) {
+                    greedy[i] -= d + 1;
+                    rank[i] += sum - (d + 1);
+                } else {
+                    rank[i] += sum;
+                }
+            }
+        } else if (sum < 0) {
+            for (int i = 0; i <= d; i++) {
+                if (rank[i] < -sum) {
+                    greedy[i] += d + 1;
+                    rank[i] += (d + 1) + sum;
+                } else {
+                    rank[i] += sum;
+                }
+            }
+        }
+
+        // Barycentric coordinates of the point in its simplex.
+        std::fill(barycentric.begin(), barycentric.end(), 0.0f);
+        for (int i = 0; i <= d; i++) {
+            const float delta = (elevated[i] - float(greedy[i])) * scale;
+            barycentric[d - rank[i]] += delta;
+            barycentric[d + 1 - rank[i]] -= delta;
+        }
+        barycentric[0] += 1.0f + barycentric[d + 1];
+
+        for (int r = 0; r <= d; r++) {
+            // The last coordinate is redundant (coordinates sum to zero) and is not part of the key.
+            for (int i = 0; i < d; i++)
+                key[i] = greedy[i] + canonical[size_t(r) * (d + 1) + rank[i]];
+            const int vertex = findOrInsert(key.data());
+            float* target = &values[size_t(vertex) * vd];
+            for (int c = 0; c < vd; c++)
+                target[c] += barycentric[r] * value[c];
+            replay[size_t(index) * (d + 1) + r] = { vertex, barycentric[r] };
+        }
+    }
+
+    /** Blurs the lattice values with [1 2 1] / 4 along each of the d + 1 lattice directions. */
+    void blur()
+    {
+        const int num_vertices = int(keys.size() / d);
+        std::vector<float> blurred(values.size());
+        const std::vector<float> zeros(vd, 0.0f);
+
+        for (int direction = 0; direction <= d; direction++) {
+            #pragma omp parallel
+            {
+                std::vector<int> neighbor_minus(d), neighbor_plus(d);
+                #pragma omp for
+                for (int vertex = 0; vertex < num_vertices; vertex++) {
+                    const int* k = &keys[size_t(vertex) * d];
+                    // Neighbours along the lattice direction: +-1 in every coordinate, -+d in coordinate `direction`.
+                    for (int i = 0; i < d; i++) {
+                        neighbor_minus[i] = k[i] + 1;
+                        neighbor_plus[i] = k[i] - 1;
+                    }
+                    if (direction < d) {
+                        neighbor_minus[direction] = k[direction] - d;
+                        neighbor_plus[direction] = k[direction] + d;
+                    }
+                    const int minus = find(neighbor_minus.data());
+                    const int plus = find(neighbor_plus.data());
+                    const float* v_minus = minus >= 0 ? &values[size_t(minus) * vd] : zeros.data();
+                    const float* v_plus = plus >= 0 ? &values[size_t(plus) * vd] : zeros.data();
+                    const float* v = &values[size_t(vertex) * vd];
+                    float* out = &blurred[size_t(vertex) * vd];
+                    for (int c = 0; c < vd; c++)
+                        out[c] = 0.25f * v_minus[c] + 0.5f * v[c] + 0.25f * v_plus[c];
+                }
+            }
+            values.swap(blurred);
+        }
+    }
+
+    /** Interpolates the lattice values at point `index` (as splatted) into `out` (vd values). */
+    void slice(const int index, float* out) const
+    {
+        std::fill(out, out + vd, 0.0f);
+        for (int r = 0; r <= d; r++) {
+            const auto& [vertex, weight] = replay[size_t(index) * (d + 1) + r];
+            const float* v = &values[size_t(vertex) * vd];
+            for (int c = 0; c < vd; c++)
+                out[c] += weight * v[c];
+        }
+    }
+
+    int numVertices() const { return int(keys.size() / d); }
+
+private:
+    struct ReplayEntry {
+        int vertex;
+        float weight;
+    };
+
+    size_t hash(const int* k) const
+    {
+        size_t h = 0;
+        for (int i = 0; i < d; i++)
+            h = (h + size_t(uint32_t(k[i]))) * 2531011u;
+        return h;
+    }
+
+    /** Open-addressing lookup; returns the vertex index or -1. */
+    int find(const int* k) const
+    {
+        const size_t mask = table_entries.size() - 1;
+        for (size_t slot = hash(k) & mask;; slot = (slot + 1) & mask) {
+            const int vertex = table_entries[slot];
+            if (vertex < 0)
+                return -1;
+            if (std::equal(k, k + d, &keys[size_t(vertex) * d]))
+                return vertex;
+        }
+    }
+
+    int findOrInsert(const int* k)
+    {
+        // Keep the load factor below 1/2.
+        if (2 * (keys.size() / d + 1) > table_entries.size())
+            grow();
+
+        const size_t mask = table_entries.size() - 1;
+        for (size_t slot = hash(k) & mask;; slot = (slot + 1) & mask) {
+            const int vertex = table_entries[slot];
+            if (vertex < 0) {
+                const int new_vertex = int(keys.size() / d);
+                keys.insert(keys.end(), k, k + d);
+                values.resize(values.size() + vd, 0.0f);
+                table_entries[slot] = new_vertex;
+                return new_vertex;
+            }
+            if (std::equal(k, k + d, &keys[size_t(vertex) * d]))
+                return vertex;
+        }
+    }
+
+    void grow()
+    {
+        table_entries.assign(table_entries.size() * 2, -1);
+        const size_t mask = table_entries.size() - 1;
+        const int num_vertices = int(keys.size() / d);
+        for (int vertex = 0; vertex < num_vertices; vertex++) {
+            size_t slot = hash(&keys[size_t(vertex) * d]) & mask;
+            while (table_entries[slot] >= 0)
+                slot = (slot + 1) & mask;
+            table_entries[slot] = vertex;
+        }
+    }
+
+    int d, vd;
+    std::vector<float> scale_factor;
+    std::vector<int> canonical;
+    std::vector<ReplayEntry> replay;
+
+    // Lattice vertices: keys (d coordinates each), values (vd each) and the hash table over them.
+    std::vector<int> keys;
+    std::vector<float> values;
+    std::vector<int> table_entries;
+
+    // Scratch for splat().
+    std::vector<float> elevated;
+    std::vector<int> greedy;
+    std::vector<int> rank;
+    std::vector<float> barycentric;
+    std::vector<int> key;
+};
+
+/// <summary>
+/// Joint (cross) bilateral filter on the permutohedral lattice.
+/// Filters every plane of `values` with Gaussian weights on the pixel distance (space_sigma) and on the distance
+/// between the `guide` planes (range_sigma), e.g. RGB or XYZ planes. All planes must have the same size.
+/// Runs in O(pixels * (guide planes + 2)^2).
+/// </summary>
+std::vector<ImageFloat> jointBilateralFilterPermutohedral(std::span<const ImageFloatView> values, std::span<const ImageFloatView> guide, const float space_sigma, const float range_sigma)
+{
+    assert(!values.empty() && !guide.empty());
+    const int width = values[0].width;
+    const int height = values[0].height;
+    const int d = 2 + int(guide.size());
+    const int vd = int(values.size()) + 1;
+    const int num_points = width * height;
+
+    PermutohedralLattice lattice(d, vd, num_points);
+    {
+        std::vector<float> position(d), value(vd);
+        value[vd - 1] = 1.0f; // Homogeneous weight.
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                position[0] = float(x) / space_sigma;
+                position[1] = float(y) / space_sigma;
+                for (size_t g = 0; g < guide.size(); g++)
+                    position[2 + g] = guide[g].at(x, y) / range_sigma;
+                for (size_t c = 0; c < values.size(); c++)
+                    value[c] = values[c].at(x, y);
+                lattice.splat(y * width + x, position.data(), value.data());
+            }
+        }
+    }
+
+    lattice.blur();
+
+    std::vector<ImageFloat> result;
+    result.reserve(values.size());
+    for (size_t c = 0; c < values.size(); c++)
+        result.emplace_back(width, height, ImageLayout {}, ImageInit::Uninitialized);
+
+    #pragma omp parallel
+    {
+        std::vector<float> sample(vd);
+        #pragma omp for
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                lattice.slice(y * width + x, sample.data());
+                const float weight = sample[vd - 1];
+                for (size_t c = 0; c < values.size(); c++)
+                    result[c].row(y)[x] = weight > 0.0f ? sample[c] / weight : values[c].at(x, y);
+            }
+        }
+    }
+
+    return result;
+}
+
+/// <summary> Joint bilateral filter of a single plane. </summary>
+ImageFloat jointBilateralFilterPermutohedral(const ImageFloatView value, std::span<const ImageFloatView> guide, const float space_sigma, const float range_sigma)
+{
+    const ImageFloatView values[] = { value };
+    return std::move(jointBilateralFilterPermutohedral(values, guide, space_sigma, range_sigma)[0]);
+}
+
+/// <summary> Filters all planes of an XYZ (or any 3-plane) image guided by the planes of `guide`. </summary>
+ImageFloatPlane3 jointBilateralFilterPermutohedral(const ImageFloatPlane3& values, const ImageFloatPlane3& guide, const float space_sigma, const float range_sigma)
+{
+    const ImageFloatView value_planes[] = { values.X, values.Y, values.Z };
+    const ImageFloatView guide_planes[] = { guide.X, guide.Y, guide.Z };
+    auto filtered = jointBilateralFilterPermutohedral(value_planes, guide_planes, space_sigma, range_sigma);
+    return ImageFloatPlane3 { std::move(filtered[0]), std::move(filtered[1]), std::move(filtered[2]) };
+}
+
+/// <summary>
+/// Bilateral filter of H guided by itself on the permutohedral lattice (same signature as bilateralFilter;
+/// `size` is only validated, the spatial Gaussian is not truncated).
+/// </summary>
+ImageFloat bilateralFilterPermutohedral(const ImageFloatView H, const int size, const float space_sigma, const float range_sigma)
+{
+    assert(size % 2 == 1);
+    const ImageFloatView guide[] = { H };
+    return jointBilateralFilterPermutohedral(H, guide, space_sigma, range_sigma);
+}
@@ -0,0 +1,197 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+
+#include "helpers.h"
+
+/*
+ * Discrete Poisson problem shared by the solvers of solvePoisson (see PoissonMethod).
+ *
+ * For a w x h image I and the (w + 2) x (h + 2) divergence div G of getDivergence, every pixel satisfies the
+ * 5-point equation
+ *   I(x - 1, y) + I(x + 1, y) + I(x, y - 1) + I(x, y + 1) - 4 I(x, y) = div G(x + 1, y + 1),
+ * with I = 0 outside the image (getGradients pads the image with zeros). The operator is symmetric negative
+ * definite, so the system has a single solution whatever the initial guess; the solvers only differ in how fast
+ * they reach it. Coarser multigrid levels use the same stencil with a right-hand side scaled by h^2.
+ *
+ * Convergence is measured by the relative residual |div G - lap I| / |div G| (L2 norms over all pixels).
+ * solvePoissonMasked (poisson_masked.h) only solves for the pixels of a mask and keeps the others fixed.
+ */
+
+/** Solver used by solvePoisson(initial_solution, divergence_G, settings). */
+enum class PoissonMethod {
+    Jacobi, // Jacobi sweeps until the relative residual drops below tolerance (0 = exactly max_iterations sweeps).
+    Multigrid, // Geometric multigrid cycles until the relative residual drops below tolerance (see poisson_multigrid.h).
+    RedBlackSor, // In-place red-black successive over-relaxation until the relative residual drops below tolerance (see poisson_sor.h).
+    ConjugateGradient, // Matrix-free preconditioned conjugate gradient (see poisson_cg.h).
+    Direct, // Exact solution with two 2D discrete sine transforms; tolerance and iterations are unused (see poisson_dst.h).
+};
+
+/** Preconditioner of PoissonMethod::ConjugateGradient. */
+enum class PoissonPreconditioner {
+    Jacobi, // Diagonal scaling; the 5-point diagonal is constant, so this is plain CG.
+    IncompleteCholesky, // IC(0) factorization of the 5-point matrix (sequential triangular solves).
+    Multigrid, // One symmetric V-cycle of poisson_multigrid.h.
+};
+
+/** Multigrid cycle: V visits every level once per cycle, F re-solves each coarse level with a V-cycle on the way up. */
+enum class MultigridCycle {
+    V,
+    F,
+};
+
+/** Outcome of an iterative solve, also passed to PoissonSettings::progress while it runs. */
+struct PoissonReport {
+    int iterations = 0; // Sweeps, cycles or CG iterations run.
+    double relative_residual = 0.0; // At the end of the last one.
+};
+
+/** Sweeps of the single-level solvers (Jacobi, RedBlackSor) between two residual checks; a check costs about a sweep. */
+constexpr int POISSON_CHECK_INTERVAL = 10;
+
+struct PoissonSettings {
+    PoissonMethod method = PoissonMethod::Multigrid;
+    float tolerance = 1e-6f; // Relative residual at which the iterative solvers stop (float rounding floors it at ~1e-7).
+    int max_iterations = 10000; // Sweeps (Jacobi, RedBlackSor), cycles (Multigrid) or iterations (ConjugateGradient).
+    MultigridCycle cycle = MultigridCycle::F; // Fewer cycles than V on even sizes, for ~1.5x the work per cycle.
+    float omega = 0.0f; // RedBlackSor relaxation factor in (0, 2); 0 picks the optimal one for the image size.
+    PoissonPreconditioner preconditioner = PoissonPreconditioner::Multigrid;
+    // Called at every residual check: after each cycle or CG iteration, every POISSON_CHECK_INTERVAL sweeps.
+    std::function<void(const PoissonReport&)> progress = {};
+};
+
+/** Right-hand side of pixel (x, y): the interior of the (w + 2) x (h + 2) divergence. */
+inline ImageFloatView poissonRightHandSide(const ImageFloatView divergence_G)
+{
+    assert(divergence_G.width >= 2 && divergence_G.height >= 2);
+    return divergence_G.roi(1, 1, divergence_G.width - 2, divergence_G.height - 2);
+}
+
+/** Sum of the 4 neighbours of (x, y), 0 outside the image. */
+inline float poissonNeighbourSum(const ImageFloatView I, const int x, const int y)
+{
+    const float* row = I.row(y);
+    return (x > 0 ? row[x - 1] : 0.0f) + (x + 1 < I.width ? row[x + 1] : 0.0f)
+        + (y > 0 ? I.row(y - 1)[x] : 0.0f) + (y + 1 < I.height ? I.row(y + 1)[x] : 0.0f);
+}
+
+/**
+ * One red-black Gauss-Seidel sweep of lap I = f in place: pixels with (x + y) even, then odd (odd first when
+ * `reversed`, which makes a reversed sweep the adjoint of a forward one). Pixels of one color only read the other
+ * color, so each half-sweep is a parallel Jacobi step that already sees the first half's values. omega > 1
+ * over-relaxes (SOR).
+ */
+inline void poissonRedBlackSweep(const MutableImageFloatView I, const ImageFloatView f, const float omega = 1.0f, const bool reversed = false)
+{
+    assert(I.width == f.width && I.height == f.height);
+    for (int pass = 0; pass < 2; pass++) {
+        const int color = reversed ? 1 - pass : pass;
+        #pragma omp parallel for
+        for (int y = 0; y < I.height; y++) {
+            float* row = I.row(y);
+            const float* rhs = f.row(y);
+            const float* above = y > 0 ? I.row(y - 1) : nullptr;
+            const float* below = y + 1 < I.height ? I.row(y + 1) : nullptr;
+            for (int x = (y + color) & 1; x < I.width; x += 2) {
+                float sum = (x > 0 ? row[x - 1] : 0.0f) + (x + 1 < I.width ? row[x + 1] : 0.0f);
+                sum += (above ? above[x] : 0.0f) + (below ? below[x] : 0.0f);
+                row[x] += omega * (0.25f * (sum - rhs[x]) - row[x]);
+            }
+        }
+    }
+}
+
+/** poissonRedBlackSweep over the pixels where `active` is non-zero only; the others keep their value. */
+inline void poissonRedBlackSweepMasked(const MutableImageFloatView I, const ImageFloatView f, const ImageView<uint8_t> active, const float omega = 1.0f, const bool reversed = false)
+{
+    assert(I.width == f.width && I.height == f.height && I.width == active.width && I.height == active.height);
+    for (int pass = 0; pass < 2; pass++) {
+        const int color = reversed ? 1 - pass : pass;
+        #pragma omp parallel for
+        for (int y = 0; y < I.height; y++) {
+            float* row = I.row(y);
+            const float* rhs = f.row(y);
+            const uint8_t* mask = active.row(y);
+            const float* above = y > 0 ? I.row(y - 1) : nullptr;
+            const float* below = y + 1 < I.height ? I.row(y + 1) : nullptr;
+            for (int x = (y + color) & 1; x < I.width; x += 2) {
+                if (!mask[x])
+                    continue;
+                float sum = (x > 0 ? row[x - 1] : 0.0f) + (x + 1 < I.width ? row[x + 1] : 0.0f);
+                sum += (above ? above[x] : 0.0f) + (below ? below[x] : 0.0f);
+                row[x] += omega * (0.25f * (sum - rhs[x]) - row[x]);
+            }
+        }
+    }
+}
+
+/** residual = f - lap I. Returns |residual|^2. */
+inline double poissonResidual(const ImageFloatView I, const ImageFloatView f, const MutableImageFloatView residual)
+{
+    assert(I.width == f.width && I.height == f.height && residual.width == f.width && residual.height == f.height);
+    double norm2 = 0.0;
+    #pragma omp parallel for reduction(+ : norm2)
+    for (int y = 0; y < I.height; y++) {
+        const float* row = I.row(y);
+        const float* rhs = f.row(y);
+        float* dst = residual.row(y);
+        for (int x = 0; x < I.width; x++) {
+            dst[x] = rhs[x] - (poissonNeighbourSum(I, x, y) - 4.0f * row[x]);
+            norm2 += double(dst[x]) * dst[x];
+        }
+    }
+    return norm2;
+}
+
+/** |f - lap I|^2, without storing the residual. */
+inline double poissonResidualNorm2(const ImageFloatView I, const ImageFloatView f)
+{
+    assert(I.width == f.width && I.height == f.height);
+    double norm2 = 0.0;
+    #pragma omp parallel for reduction(+ : norm2)
+    for (int y = 0; y < I.height; y++) {
+        const float* row = I.row(y);
+        const float* rhs = f.row(y);
+        for (int x = 0; x < I.width; x++) {
+            const float r = rhs[x] - (poissonNeighbourSum(I, x, y) - 4.0f * row[x]);
+            norm2 += double(r) * r;
+        }
+    }
+    return norm2;
+}
+
+/** |f|^2. */
+inline double poissonNorm2(const ImageFloatView f)
+{
+    double norm2 = 0.0;
+    #pragma omp parallel for reduction(+ : norm2)
+    for (int y = 0; y < f.height; y++) {
+        const float* row = f.row(y);
+        for (int x = 0; x < f.width; x++)
+            norm2 += double(row[x]) * row[x];
+    }
+    return norm2;
+}
+
+/** Sets the pixels of I where `active` is 0 to 0 (the fixed pixels of a masked solve, see poisson_masked.h). */
+inline void poissonMaskInactive(const MutableImageFloatView I, const ImageView<uint8_t> active)
+{
+    assert(I.width == active.width && I.height == active.height);
+    #pragma omp parallel for
+    for (int y = 0; y < I.height; y++) {
+        float* row = I.row(y);
+        const uint8_t* mask = active.row(y);
+        for (int x = 0; x < I.width; x++)
+            row[x] = mask[x] ? row[x] : 0.0f;
+    }
+}
+
+/** Denominator of the relative residual: |f|, or 1 (absolute residual) when f = 0. */
+inline double poissonResidualScale(const ImageFloatView f)
+{
+    const double norm = std::sqrt(poissonNorm2(f));
+    return norm > 0.0 ? norm : 1.0;
+}
@@ -0,0 +1,259 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "helpers.h"
+#include "poisson.h"
+#include "poisson_multigrid.h"
+
+/*
+ * Matrix-free preconditioned conjugate gradient solver of the Poisson problem of poisson.h.
+ *
+ * CG runs on K I = -div G with K = -lap, which is symmetric positive definite; K p is evaluated from the stencil,
+ * the matrix is never stored. Preconditioners (PoissonPreconditioner):
+ *  - Jacobi: z = r / 4. The diagonal is constant, so the iterates are those of plain CG, ~O(max(w, h)) iterations.
+ *  - IncompleteCholesky: IC(0), K ~ (D + L) D^-1 (D + L)^T with L the left / upper neighbour couplings and
+ *    d(x, y) = 4 - 1 / d(x - 1, y) - 1 / d(x, y - 1). About half the iterations of plain CG, but the two
+ *    triangular solves run sequentially.
+ *  - Multigrid: one V-cycle with reversed post-smoothing (a symmetric operator) from a zero guess. The iteration
+ *    count no longer grows with the image size.
+ * The multigrid coarsest solve stops on a residual test, so that preconditioner varies slightly from one iteration
+ * to the next; beta uses the Polak-Ribiere form z.(r - r_old) / z_old.r_old, which stays robust to it (and equals
+ * the usual z.r / z_old.r_old for a fixed preconditioner).
+ *
+ * Vectors are float, dot products are accumulated in double.
+ *
+ * poissonConjugateGradient optionally restricts the unknowns to the non-zero pixels of an `active` mask (the
+ * masked solve of poisson_masked.h): the other pixels stay 0 and K becomes P K P, P zeroing them. P K P is still
+ * positive definite on the active pixels, and P M P stays a symmetric preconditioner for each M above.
+ */
+
+/** IC(0) preconditioner of K = -lap: stores 1 / d(x, y). */
+class PoissonIncompleteCholesky {
+public:
+    /** With `active`, factorizes P K P: inactive pixels get 1 / d = 0 and drop out of both triangular solves. */
+    PoissonIncompleteCholesky(const int width, const int height, ImagePool* pool = nullptr, const ImageView<uint8_t>* active = nullptr);
+    ~PoissonIncompleteCholesky();
+    PoissonIncompleteCholesky(const PoissonIncompleteCholesky&) = delete;
+    PoissonIncompleteCholesky& operator=(const PoissonIncompleteCholesky&) = delete;
+
+    /** z = ((D + L) D^-1 (D + L)^T)^-1 r. */
+    void apply(const ImageFloatView r, const MutableImageFloatView z) const;
+
+private:
+    ImagePool* pool;
+    ImageFloat inverse_diagonal;
+};
+
+inline PoissonIncompleteCholesky::PoissonIncompleteCholesky(const int width, const int height, ImagePool* new_pool, const ImageView<uint8_t>* active)
+    : pool(new_pool)
+    , inverse_diagonal(new_pool ? new_pool->acquire<float>(width, height, ImageInit::Uninitialized) : ImageFloat(width, height, {}, ImageInit::Uninitialized))
+{
+    // The factorization is computed in double: d(x, y) converges to 2 + sqrt(2) along the recurrence. 1 / d is 0
+    // outside the image and on inactive pixels.
+    std::vector<double> above(width, 0.0);
+    for (int y = 0; y < height; y++) {
+        float* dst = inverse_diagonal.row(y);
+        double left = 0.0;
+        for (int x = 0; x < width; x++) {
+            if (active && !active->at(x, y)) {
+                dst[x] = 0.0f;
+                left = above[x] = 0.0;
+                continue;
+            }
+            const double d = 4.0 - left - above[x];
+            dst[x] = float(1.0 / d);
+            left = above[x] = 1.0 / d;
+        }
+    }
+}
+
+inline PoissonIncompleteCholesky::~PoissonIncompleteCholesky()
+{
+    if (pool)
+        pool->release(std::move(inverse_diagonal));
+}
+
+inline void PoissonIncompleteCholesky::apply(const ImageFloatView r, const MutableImageFloatView z) const
+{
+    // (D + L) w = r: w = (r + w_left + w_up) / d.
+    for (int y = 0; y < z.height; y++) {
+        const float* rhs = r.row(y);
+        const float* inverse = inverse_diagonal.row(y);
+        const float* above = y > 0 ? z.row(y - 1) : nullptr;
+        float* dst = z.row(y);
+        for (int x = 0; x < z.width; x++)
+            dst[x] = (rhs[x] + (x > 0 ? dst[x - 1] : 0.0f) + (above ? above[x] : 0.0f)) * inverse[x];
+    }
+    // (D + L)^T z = D w: z = w + (z_right + z_down) / d.
+    for (int y = z.height - 1; y >= 0; y--) {
+        const float* inverse = inverse_diagonal.row(y);
+        const float* below = y + 1 < z.height ? z.row(y + 1) : nullptr;
+        float* dst = z.row(y);
+        for (int x = z.width - 1; x >= 0; x--)
+            dst[x] += ((x + 1 < z.width ? dst[x + 1] : 0.0f) + (below ? below[x] : 0.0f)) * inverse[x];
+    }
+}
+
+/** q = K p = 4 p - (sum of the 4 neighbours). Returns p.q. */
+inline double poissonApplyNegativeLaplacian(const ImageFloatView p, const MutableImageFloatView q)
+{
+    double dot = 0.0;
+    #pragma omp parallel for reduction(+ : dot)
+    for (int y = 0; y < p.height; y++) {
+        const float* src = p.row(y);
+        float* dst = q.row(y);
+        for (int x = 0; x < p.width; x++) {
+            dst[x] = 4.0f * src[x] - poissonNeighbourSum(p, x, y);
+            dot += double(src[x]) * dst[x];
+        }
+    }
+    return dot;
+}
+
+/** a.b in double. */
+inline double poissonDot(const ImageFloatView a, const ImageFloatView b)
+{
+    double dot = 0.0;
+    #pragma omp parallel for reduction(+ : dot)
+    for (int y = 0; y < a.height; y++) {
+        const float* ra = a.row(y);
+        const float* rb = b.row(y);
+        for (int x = 0; x < a.width; x++)
+            dot += double(ra[x]) * rb[x];
+    }
+    return dot;
+}
+
+/**
+ * Preconditioned CG on lap I = f, improving I in place; settings as for solvePoissonConjugateGradient. With
+ * `active`, only its non-zero pixels are unknowns: I must be 0 elsewhere and stays so, and the residual and its
+ * scale only cover the active pixels.
+ */
+inline PoissonReport poissonConjugateGradient(const MutableImageFloatView I, const ImageFloatView f, const PoissonSettings& settings, ImagePool* pool = nullptr, const ImageView<uint8_t>* active = nullptr)
+{
+    assert(f.width == I.width && f.height == I.height);
+    const int width = f.width, height = f.height;
+    auto acquire = [&]() {
+        return pool ? pool->acquire<float>(width, height, ImageInit::Uninitialized) : ImageFloat(width, height, {}, ImageInit::Uninitialized);
+    };
+    auto mask = [&](const MutableImageFloatView image) {
+        if (active)
+            poissonMaskInactive(image, *active);
+    };
+    // |f - lap I|^2 over the unknowns, `residual` receiving f - lap I.
+    auto residualNorm2 = [&](const MutableImageFloatView residual) {
+        const double norm2 = poissonResidual(I, f, residual);
+        if (!active)
+            return norm2;
+        mask(residual);
+        return poissonNorm2(residual);
+    };
+
+    // r = -div G - K I = -(div G - lap I); r_old is the residual of the previous iteration.
+    auto r = acquire(), r_old = acquire(), z = acquire(), p = acquire(), q = acquire();
+    double scale = poissonResidualScale(f);
+    if (active) {
+        q.view().copyFrom(f);
+        mask(q);
+        scale = poissonResidualScale(q);
+    }
+    double relative_residual = std::sqrt(residualNorm2(r)) / scale;
+    r.apply([&](const int x, const int y) { return -r.at(x, y); });
+
+    std::unique_ptr<PoissonMultigrid> multigrid;
+    std::unique_ptr<PoissonIncompleteCholesky> cholesky;
+    if (settings.preconditioner == PoissonPreconditioner::Multigrid)
+        multigrid = std::make_unique<PoissonMultigrid>(width, height, pool, active);
+    else if (settings.preconditioner == PoissonPreconditioner::IncompleteCholesky)
+        cholesky = std::make_unique<PoissonIncompleteCholesky>(width, height, pool, active);
+    auto precondition = [&]() {
+        if (multigrid) {
+            // K z = r is lap z = -r: one V-cycle on lap z' = r from zero, then z = -z'.
+            z.view().fill(0.0f);
+            multigrid->cycle(z, r, MultigridCycle::V);
+            z.apply([&](const int x, const int y) { return -z.at(x, y); });
+        } else if (cholesky) {
+            cholesky->apply(r, z);
+        } else {
+            z.apply([&](const int x, const int y) { return 0.25f * r.at(x, y); });
+        }
+    };
+
+    precondition();
+    p.view().copyFrom(z);
+    double rz = poissonDot(r, z);
+    int iterations = 0;
+    for (; iterations < settings.max_iterations && relative_residual > settings.tolerance && rz > 0.0; iterations++) {
+        const float alpha = float(rz / poissonApplyNegativeLaplacian(p, q));
+        mask(q);
+        std::swap(r, r_old);
+        double r_norm2 = 0.0;
+        #pragma omp parallel for reduction(+ : r_norm2)
+        for (int y = 0; y < height; y++) {
+            float* solution = I.row(y);
+            float* residual = r.row(y);
+            const float* residual_old = r_old.row(y);
+            const float* direction = p.row(y);
+            const float* product = q.row(y);
+            for (int x = 0; x < width; x++) {
+                solution[x] += alpha * direction[x];
+                residual[x] = residual_old[x] - alpha * product[x];
+                r_norm2 += double(residual[x]) * residual[x];
+            }
+        }
+        relative_residual = std::sqrt(r_norm2) / scale;
+        if (settings.progress)
+            settings.progress({ iterations + 1, relative_residual });
+        if (relative_residual <= settings.tolerance)
+            continue;
+
+        precondition();
+        const double rz_new = poissonDot(r, z);
+        const float beta = float((rz_new - poissonDot(r_old, z)) / rz);
+        rz = rz_new;
+        #pragma omp parallel for
+        for (int y = 0; y < height; y++) {
+            float* direction = p.row(y);
+            const float* preconditioned = z.row(y);
+            for (int x = 0; x < width; x++)
+                direction[x] = preconditioned[x] + beta * direction[x];
+        }
+    }
+
+    // The recursively updated residual drifts away from the true one in float; report the true one.
+    if (iterations > 0)
+        relative_residual = std::sqrt(residualNorm2(q)) / scale;
+
+    if (pool) {
+        pool->release(std::move(r));
+        pool->release(std::move(r_old));
+        pool->release(std::move(z));
+        pool->release(std::move(p));
+        pool->release(std::move(q));
+    }
+    return { iterations, relative_residual };
+}
+
+/// <summary>
+/// Solves lap I = div G with preconditioned conjugate gradient, starting from initial_solution.
+/// </summary>
+/// <param name="settings">preconditioner, relative residual tolerance and maximum number of iterations</param>
+/// <param name="pool">optional pool providing (and recycling) the solver buffers</param>
+/// <param name="report">optional, receives the number of iterations and the final relative residual</param>
+ImageFloat solvePoissonConjugateGradient(const ImageFloatView initial_solution, const ImageFloatView divergence_G, const PoissonSettings& settings, ImagePool* pool = nullptr, PoissonReport* report = nullptr)
+{
+    const ImageFloatView f = poissonRightHandSide(divergence_G);
+    assert(f.width == initial_solution.width && f.height == initial_solution.height);
+
+    auto I = pool ? pool->acquire<float>(f.width, f.height, ImageInit::Uninitialized) : ImageFloat(f.width, f.height, {}, ImageInit::Uninitialized);
+    I.view().copyFrom(initial_solution);
+    const PoissonReport result = poissonConjugateGradient(I, f, settings, pool);
+    if (report)
+        *report = result;
+    return I;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cassert>
+#include <cmath>
+#include <numbers>
+#include <vector>
+
+#include <framework/fft.h>
+
+#include "helpers.h"
+#include "poisson.h"
+
+/*
+ * Direct solver of the Poisson problem of poisson.h with the type-I discrete sine transform.
+ *
+ * With I = 0 one pixel outside the rectangle, the sines sin(pi (x + 1) (k + 1) / (w + 1)) are eigenvectors of the
+ * 1D second difference with eigenvalues 2 cos(pi (k + 1) / (w + 1)) - 2, so the 2D DST-I diagonalizes the 5-point
+ * Laplacian:
+ *   I = DST^-1( DST(div G) / (lambda_x(k) + lambda_y(l)) ),
+ * all eigenvalue sums being negative. Two 2D transforms (DST2D in framework/fft.h, any size, rows and columns in
+ * parallel) give the exact solution in O(N log N), whatever the initial guess, which is ignored.
+ *
+ * Transforms are float; the result matches the exact solution to ~1e-6 relative.
+ */
+
+/// <summary>
+/// Solves lap I = div G exactly with two 2D sine transforms.
+/// </summary>
+/// <param name="pool">optional pool providing the solution buffer</param>
+/// <param name="report">optional, receives 1 iteration and the relative residual of the result</param>
+ImageFloat solvePoissonDirect(const ImageFloatView divergence_G, ImagePool* pool = nullptr, PoissonReport* report = nullptr)
+{
+    const ImageFloatView f = poissonRightHandSide(divergence_G);
+    const int width = f.width, height = f.height;
+
+    auto eigenvalues = [](const int n) {
+        std::vector<float> lambda(n);
+        for (int k = 0; k < n; k++)
+            lambda[k] = float(2.0 * std::cos(std::numbers::pi * (k + 1) / (n + 1)) - 2.0);
+        return lambda;
+    };
+    const std::vector<float> lambda_x = eigenvalues(width), lambda_y = eigenvalues(height);
+
+    auto I = pool ? pool->acquire<float>(width, height, ImageInit::Uninitialized) : ImageFloat(width, height, {}, ImageInit::Uninitialized);
+    I.view().copyFrom(f);
+    const DST2D dst(width, height);
+    dst.forward(I);
+
+    // The inverse DST-I is the forward one scaled by 2 / (n + 1) per axis; fold it into the division.
+    const float normalization = 4.0f / (float(width + 1) * float(height + 1));
+    #pragma omp parallel for
+    for (int y = 0; y < height; y++) {
+        float* row = I.row(y);
+        for (int x = 0; x < width; x++)
+            row[x] *= normalization / (lambda_x[x] + lambda_y[y]);
+    }
+    dst.forward(I);
+
+    if (report)
+        *report = { 1, std::sqrt(poissonResidualNorm2(I, f)) / poissonResidualScale(f) };
+    return I;
+}
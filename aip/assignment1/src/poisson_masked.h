@@ -0,0 +1,182 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+
+#include "helpers.h"
+#include "poisson.h"
+#include "poisson_cg.h"
+#include "poisson_multigrid.h"
+#include "poisson_sor.h"
+
+/*
+ * Poisson solve restricted to the pixels of a mask, for seamless cloning.
+ *
+ * Pixels with mask > 0.5 are the unknowns; every other pixel keeps its current value (the target) and acts as a
+ * Dirichlet boundary. For an unknown p, the equation of poisson.h becomes
+ *   sum of the unknown neighbours q of p (I(q)) - 4 I(p) = div G(p) - sum of the fixed neighbours q of p (I(q)),
+ * so the solve only touches the bounding box of the mask (PoissonRegion): the unknowns are copied into a box-sized
+ * buffer with the fixed pixels set to 0, the fixed values are moved to the right-hand side, and the result is
+ * written back to the masked pixels. Building the region scans the mask once; everything else costs O(box).
+ *
+ * Unlike solvePoisson, which also re-solves the pixels outside the mask, the target is reproduced exactly outside
+ * the mask, as in the original formulation of Poisson image editing (Perez et al. 2003).
+ */
+
+/** Unknowns of a masked solve: the bounding box of the mask within the image, and which of its pixels are active. */
+struct PoissonRegion {
+    int x = 0, y = 0, width = 0, height = 0; // Bounding box; 0 x 0 when the mask is empty.
+    ImageMask8 active; // width x height, 1 for the unknowns.
+
+    bool empty() const { return width == 0; }
+};
+
+/** Region of the pixels with mask > 0.5. */
+inline PoissonRegion poissonRegion(const ImageFloatView mask)
+{
+    int x_min = INT_MAX, y_min = INT_MAX, x_max = -1, y_max = -1;
+    #pragma omp parallel for reduction(min : x_min, y_min) reduction(max : x_max, y_max)
+    for (int y = 0; y < mask.height; y++) {
+        const float* row = mask.row(y);
+        for (int x = 0; x < mask.width; x++) {
+            if (row[x] > 0.5f) {
+                x_min = std::min(x_min, x);
+                x_max = std::max(x_max, x);
+                y_min = std::min(y_min, y);
+                y_max = std::max(y_max, y);
+            }
+        }
+    }
+
+    PoissonRegion region;
+    if (x_max < 0)
+        return region;
+    region.x = x_min;
+    region.y = y_min;
+    region.width = x_max - x_min + 1;
+    region.height = y_max - y_min + 1;
+    region.active = ImageMask8(region.width, region.height, {}, ImageInit::Uninitialized);
+    #pragma omp parallel for
+    for (int y = 0; y < region.height; y++) {
+        const float* row = mask.row(region.y + y) + region.x;
+        uint8_t* dst = region.active.row(y);
+        for (int x = 0; x < region.width; x++)
+            dst[x] = row[x] > 0.5f ? 1 : 0;
+    }
+    return region;
+}
+
+/// <summary>
+/// Solves lap I = div G on the pixels of `region` only, in place: I holds the target on input, its pixels outside
+/// the region are the fixed boundary values and are left untouched.
+/// RedBlackSor and Multigrid run on the region as on a full image; every other method runs the conjugate gradient
+/// of poisson_cg.h with settings.preconditioner (the sine transform needs the whole rectangle to be unknown).
+/// </summary>
+/// <param name="settings">method, relative residual tolerance and maximum number of iterations</param>
+/// <param name="pool">optional pool providing (and recycling) the region-sized solver buffers</param>
+/// <param name="report">optional, receives the iterations used and the final relative residual over the region</param>
+void solvePoissonMasked(const MutableImageFloatView I, const ImageFloatView divergence_G, const PoissonRegion& region, const PoissonSettings& settings, ImagePool* pool = nullptr, PoissonReport* report = nullptr)
+{
+    const ImageFloatView f = poissonRightHandSide(divergence_G);
+    assert(f.width == I.width && f.height == I.height);
+    assert(region.x + region.width <= I.width && region.y + region.height <= I.height);
+    if (region.empty()) {
+        if (report)
+            *report = {};
+        return;
+    }
+    const int width = region.width, height = region.height;
+    const ImageView<uint8_t> active = region.active;
+    auto acquire = [&]() {
+        return pool ? pool->acquire<float>(width, height, ImageInit::Uninitialized) : ImageFloat(width, height, {}, ImageInit::Uninitialized);
+    };
+
+    // Unknowns (0 on the fixed pixels) and right-hand side with the fixed neighbours moved over; neighbours
+    // outside the image are 0.
+    auto u = acquire(), b = acquire();
+    auto fixed = [&](const int x, const int y) {
+        if (x < 0 || y < 0 || x >= I.width || y >= I.height)
+            return 0.0f;
+        const int i = x - region.x, j = y - region.y;
+        const bool unknown = i >= 0 && j >= 0 && i < width && j < height && active.at(i, j);
+        return unknown ? 0.0f : I.at(x, y);
+    };
+    #pragma omp parallel for
+    for (int j = 0; j < height; j++) {
+        const int y = region.y + j;
+        const uint8_t* mask = active.row(j);
+        const float* target = I.row(y) + region.x;
+        const float* rhs = f.row(y) + region.x;
+        float* unknowns = u.row(j);
+        float* dst = b.row(j);
+        for (int i = 0; i < width; i++) {
+            const int x = region.x + i;
+            unknowns[i] = mask[i] ? target[i] : 0.0f;
+            dst[i] = mask[i] ? rhs[i] - (fixed(x - 1, y) + fixed(x + 1, y) + fixed(x, y - 1) + fixed(x, y + 1)) : 0.0f;
+        }
+    }
+
+    PoissonReport result;
+    if (settings.method == PoissonMethod::RedBlackSor) {
+        assert(settings.omega >= 0.0f && settings.omega < 2.0f);
+        // The optimal factor of the bounding box slightly over-relaxes a smaller region, which still converges.
+        const float omega = settings.omega > 0.0f ? settings.omega : poissonOptimalOmega(width, height);
+        auto residual = acquire();
+        auto relativeResidual = [&](const double scale) {
+            poissonResidual(u, b, residual);
+            poissonMaskInactive(residual, active);
+            return std::sqrt(poissonNorm2(residual)) / scale;
+        };
+        // b is 0 on the fixed pixels, so |b| only covers the unknowns.
+        const double scale = poissonResidualScale(b);
+        result.relative_residual = relativeResidual(scale);
+        double stall_reference = result.relative_residual;
+        while (result.iterations < settings.max_iterations && result.relative_residual > settings.tolerance) {
+            const int count = std::min(POISSON_CHECK_INTERVAL, settings.max_iterations - result.iterations);
+            for (int i = 0; i < count; i++)
+                poissonRedBlackSweepMasked(u, b, active, omega);
+            result.iterations += count;
+            result.relative_residual = relativeResidual(scale);
+            if (settings.progress)
+                settings.progress(result);
+            if (result.iterations % POISSON_SOR_STALL_SWEEPS == 0) {
+                if (result.relative_residual >= stall_reference)
+                    break;
+                stall_reference = result.relative_residual;
+            }
+        }
+        if (pool)
+            pool->release(std::move(residual));
+    } else if (settings.method == PoissonMethod::Multigrid) {
+        PoissonMultigrid multigrid(width, height, pool, &active);
+        const double scale = poissonResidualScale(b);
+        result.relative_residual = std::sqrt(multigrid.residualNorm2(u, b)) / scale;
+        while (result.iterations < settings.max_iterations && result.relative_residual > settings.tolerance) {
+            multigrid.cycle(u, b, settings.cycle);
+            result.iterations++;
+            result.relative_residual = std::sqrt(multigrid.residualNorm2(u, b)) / scale;
+            if (settings.progress)
+                settings.progress(result);
+        }
+    } else {
+        result = poissonConjugateGradient(u, b, settings, pool, &active);
+    }
+
+    #pragma omp parallel for
+    for (int j = 0; j < height; j++) {
+        const uint8_t* mask = active.row(j);
+        const float* unknowns = u.row(j);
+        float* dst = I.row(region.y + j) + region.x;
+        for (int i = 0; i < width; i++)
+            dst[i] = mask[i] ? unknowns[i] : dst[i];
+    }
+
+    if (pool) {
+        pool->release(std::move(u));
+        pool->release(std::move(b));
+    }
+    if (report)
+        *report = result;
+}
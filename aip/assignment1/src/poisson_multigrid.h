@@ -0,0 +1,251 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+#include "helpers.h"
+#include "poisson.h"
+
+/*
+ * Geometric multigrid solver of the Poisson problem of poisson.h.
+ *
+ * Level l + 1 keeps every other pixel of level l: coarse pixel (i, j) sits on fine pixel (2i + 1, 2j + 1), and a
+ * w x h level has a ((w - 1) / 2) x ((h - 1) / 2) parent, so that the coarse zero boundary never lies outside the
+ * fine one. For odd sizes both boundaries coincide; for even sizes the last fine column (row) sits on the coarse
+ * boundary and gets no coarse correction, only smoothing. (With w / 2 the coarse boundary would fall half a
+ * coarse pixel outside the fine one and the V-cycle diverges on even sizes.)
+ * Each cycle smooths with POISSON_MULTIGRID_SMOOTHING red-black Gauss-Seidel sweeps, restricts the residual with
+ * full weighting (1 2 1 x 1 2 1 / 16), solves the coarse problem lap e = 4 R r recursively, interpolates the
+ * correction bilinearly and smooths again in the reverse color order. Levels are added until one side drops below 3 pixels; the coarsest
+ * level is swept until its residual dropped POISSON_MULTIGRID_COARSEST_REDUCTION times.
+ *
+ * A cycle reduces the error by roughly a constant factor (~0.1 for V, less for F) whatever the image size, so
+ * the work to reach a given tolerance is O(pixels), while Jacobi needs O(pixels) sweeps per pixel.
+ *
+ * With an `active` mask (the masked solve of poisson_masked.h) every level only smooths and corrects its unknowns,
+ * a coarse pixel being one when the fine pixel it sits on is: the other pixels are a zero boundary inside the
+ * rectangle on every level, and the cycle converges as fast as on a full rectangle.
+ */
+
+/** Red-black Gauss-Seidel sweeps before and after the coarse-grid correction. */
+constexpr int POISSON_MULTIGRID_SMOOTHING = 2;
+/** Residual reduction of the coarsest-level solve, and its sweep cap. */
+constexpr double POISSON_MULTIGRID_COARSEST_REDUCTION = 1e-3;
+constexpr int POISSON_MULTIGRID_COARSEST_MAX_SWEEPS = 1000;
+
+class PoissonMultigrid {
+public:
+    /**
+     * Builds the level hierarchy for a width x height problem; buffers come from `pool` when given. With `active`
+     * (whose pixels must outlive the solver), only its non-zero pixels are unknowns and the others of I must be 0.
+     */
+    PoissonMultigrid(const int width, const int height, ImagePool* pool = nullptr, const ImageView<uint8_t>* active = nullptr);
+    ~PoissonMultigrid();
+    PoissonMultigrid(const PoissonMultigrid&) = delete;
+    PoissonMultigrid& operator=(const PoissonMultigrid&) = delete;
+
+    /** One cycle on lap I = f, improving I in place. */
+    void cycle(const MutableImageFloatView I, const ImageFloatView f, const MultigridCycle type);
+
+    /** |f - lap I|^2 on the (active pixels of the) finest level. */
+    inline double residualNorm2(const ImageFloatView I, const ImageFloatView f) { return residualAt(0, I, f, fine_residual); }
+    inline int numLevels() const { return int(levels.size()) + 1; }
+
+private:
+    // Coarse levels; the finest level is the caller's I and f.
+    struct Level {
+        ImageFloat correction, rhs, residual;
+    };
+
+    void cycleAt(int level, const MutableImageFloatView I, const ImageFloatView f, const MultigridCycle type);
+    const ImageView<uint8_t>* activeAt(int level) const;
+    void smooth(int level, const MutableImageFloatView I, const ImageFloatView f, const bool reversed);
+    double residualAt(int level, const ImageFloatView I, const ImageFloatView f, const MutableImageFloatView residual) const;
+    void solveCoarsest(int level, const MutableImageFloatView I, const ImageFloatView f, const MutableImageFloatView residual);
+    static void restrictFullWeighting(const ImageFloatView fine, const MutableImageFloatView coarse);
+    static void prolongateAdd(const ImageFloatView coarse, const MutableImageFloatView fine);
+
+    ImagePool* pool;
+    ImageFloat fine_residual;
+    std::vector<Level> levels;
+    // With a mask: the unknowns of every level, the finest one being the caller's.
+    std::vector<ImageMask8> coarse_active;
+    std::vector<ImageView<uint8_t>> active_levels;
+};
+
+inline PoissonMultigrid::PoissonMultigrid(const int width, const int height, ImagePool* new_pool, const ImageView<uint8_t>* active)
+    : pool(new_pool)
+{
+    auto acquire = [&](const int w, const int h) {
+        return pool ? pool->acquire<float>(w, h, ImageInit::Uninitialized) : ImageFloat(w, h, {}, ImageInit::Uninitialized);
+    };
+    fine_residual = acquire(width, height);
+    for (int w = width, h = height; w >= 3 && h >= 3;) {
+        w = (w - 1) / 2;
+        h = (h - 1) / 2;
+        levels.push_back({ acquire(w, h), acquire(w, h), acquire(w, h) });
+    }
+    if (!active)
+        return;
+    // A coarse pixel is an unknown when the fine pixel it sits on is one.
+    coarse_active.reserve(levels.size());
+    active_levels.push_back(*active);
+    for (const Level& level : levels) {
+        const ImageView<uint8_t> fine = active_levels.back();
+        coarse_active.emplace_back(level.rhs.width, level.rhs.height, ImageLayout {}, ImageInit::Uninitialized);
+        coarse_active.back().apply([&](const int i, const int j) { return fine.at(2 * i + 1, 2 * j + 1); });
+        active_levels.push_back(coarse_active.back());
+    }
+}
+
+inline PoissonMultigrid::~PoissonMultigrid()
+{
+    if (!pool)
+        return;
+    pool->release(std::move(fine_residual));
+    for (auto& level : levels) {
+        pool->release(std::move(level.correction));
+        pool->release(std::move(level.rhs));
+        pool->release(std::move(level.residual));
+    }
+}
+
+inline void PoissonMultigrid::cycle(const MutableImageFloatView I, const ImageFloatView f, const MultigridCycle type)
+{
+    assert(I.width == fine_residual.width && I.height == fine_residual.height);
+    cycleAt(0, I, f, type);
+}
+
+inline void PoissonMultigrid::cycleAt(const int level, const MutableImageFloatView I, const ImageFloatView f, const MultigridCycle type)
+{
+    const MutableImageFloatView residual = level == 0 ? fine_residual.view() : levels[level - 1].residual.view();
+    if (level == int(levels.size())) {
+        solveCoarsest(level, I, f, residual);
+        return;
+    }
+
+    smooth(level, I, f, false);
+
+    // Coarse problem lap e = 4 R r: the coarse stencil spans 2 fine pixels, so its h^2 is 4.
+    Level& coarse = levels[level];
+    residualAt(level, I, f, residual);
+    restrictFullWeighting(residual, coarse.rhs);
+    coarse.correction.view().fill(0.0f);
+    cycleAt(level + 1, coarse.correction, coarse.rhs, type);
+    if (type == MultigridCycle::F)
+        cycleAt(level + 1, coarse.correction, coarse.rhs, MultigridCycle::V);
+    prolongateAdd(coarse.correction, I);
+    if (const ImageView<uint8_t>* mask = activeAt(level))
+        poissonMaskInactive(I, *mask);
+
+    // Reversed color order: the V-cycle is then a symmetric operator, as the CG preconditioner needs.
+    smooth(level, I, f, true);
+}
+
+inline const ImageView<uint8_t>* PoissonMultigrid::activeAt(const int level) const
+{
+    return active_levels.empty() ? nullptr : &active_levels[level];
+}
+
+inline void PoissonMultigrid::smooth(const int level, const MutableImageFloatView I, const ImageFloatView f, const bool reversed)
+{
+    const ImageView<uint8_t>* mask = activeAt(level);
+    for (int i = 0; i < POISSON_MULTIGRID_SMOOTHING; i++) {
+        if (mask)
+            poissonRedBlackSweepMasked(I, f, *mask, 1.0f, reversed);
+        else
+            poissonRedBlackSweep(I, f, 1.0f, reversed);
+    }
+}
+
+inline double PoissonMultigrid::residualAt(const int level, const ImageFloatView I, const ImageFloatView f, const MutableImageFloatView residual) const
+{
+    const double norm2 = poissonResidual(I, f, residual);
+    const ImageView<uint8_t>* mask = activeAt(level);
+    if (!mask)
+        return norm2;
+    poissonMaskInactive(residual, *mask);
+    return poissonNorm2(residual);
+}
+
+inline void PoissonMultigrid::solveCoarsest(const int level, const MutableImageFloatView I, const ImageFloatView f, const MutableImageFloatView residual)
+{
+    const ImageView<uint8_t>* mask = activeAt(level);
+    const double target = residualAt(level, I, f, residual) * POISSON_MULTIGRID_COARSEST_REDUCTION * POISSON_MULTIGRID_COARSEST_REDUCTION;
+    for (int sweep = 0; sweep < POISSON_MULTIGRID_COARSEST_MAX_SWEEPS; sweep++) {
+        if (mask)
+            poissonRedBlackSweepMasked(I, f, *mask);
+        else
+            poissonRedBlackSweep(I, f);
+        // The residual costs as much as a sweep; the coarsest level is tiny, check it every 8 sweeps.
+        if (sweep % 8 == 7 && residualAt(level, I, f, residual) <= target)
+            break;
+    }
+}
+
+inline void PoissonMultigrid::restrictFullWeighting(const ImageFloatView fine, const MutableImageFloatView coarse)
+{
+    // Coarse pixels sit on fine pixels 1 .. w - 2, their 3 x 3 neighbourhoods stay inside the fine level.
+    auto at = [&](const int x, const int y) { return fine.at(x, y); };
+    #pragma omp parallel for
+    for (int j = 0; j < coarse.height; j++) {
+        float* dst = coarse.row(j);
+        const int y = 2 * j + 1;
+        for (int i = 0; i < coarse.width; i++) {
+            const int x = 2 * i + 1;
+            const float sum = 4.0f * at(x, y)
+                + 2.0f * (at(x - 1, y) + at(x + 1, y) + at(x, y - 1) + at(x, y + 1))
+                + (at(x - 1, y - 1) + at(x + 1, y - 1) + at(x - 1, y + 1) + at(x + 1, y + 1));
+            // (sum / 16) * 4, see cycleAt.
+            dst[i] = 0.25f * sum;
+        }
+    }
+}
+
+inline void PoissonMultigrid::prolongateAdd(const ImageFloatView coarse, const MutableImageFloatView fine)
+{
+    // Fine coordinate 2i + 1 is coarse i; an even one 2i lies halfway between coarse i - 1 and i. Coarse
+    // coordinates -1 and w are the boundary, where the correction is 0.
+    auto at = [&](const int i, const int j) {
+        return i >= 0 && j >= 0 && i < coarse.width && j < coarse.height ? coarse.at(i, j) : 0.0f;
+    };
+    #pragma omp parallel for
+    for (int y = 0; y < fine.height; y++) {
+        float* dst = fine.row(y);
+        const int j1 = y / 2, j0 = y % 2 ? j1 : j1 - 1;
+        for (int x = 0; x < fine.width; x++) {
+            const int i1 = x / 2, i0 = x % 2 ? i1 : i1 - 1;
+            dst[x] += 0.25f * (at(i0, j0) + at(i1, j0) + at(i0, j1) + at(i1, j1));
+        }
+    }
+}
+
+/// <summary>
+/// Solves lap I = div G with multigrid cycles, starting from initial_solution.
+/// </summary>
+/// <param name="settings">cycle type, relative residual tolerance and maximum number of cycles</param>
+/// <param name="pool">optional pool providing (and recycling) the level buffers</param>
+/// <param name="report">optional, receives the number of cycles and the final relative residual</param>
+ImageFloat solvePoissonMultigrid(const ImageFloatView initial_solution, const ImageFloatView divergence_G, const PoissonSettings& settings, ImagePool* pool = nullptr, PoissonReport* report = nullptr)
+{
+    const ImageFloatView f = poissonRightHandSide(divergence_G);
+    assert(f.width == initial_solution.width && f.height == initial_solution.height);
+
+    auto I = pool ? pool->acquire<float>(f.width, f.height, ImageInit::Uninitialized) : ImageFloat(f.width, f.height, {}, ImageInit::Uninitialized);
+    I.view().copyFrom(initial_solution);
+
+    PoissonMultigrid multigrid(f.width, f.height, pool);
+    const double scale = poissonResidualScale(f);
+    double relative_residual = std::sqrt(multigrid.residualNorm2(I, f)) / scale;
+    int cycles = 0;
+    for (; cycles < settings.max_iterations && relative_residual > settings.tolerance; cycles++) {
+        multigrid.cycle(I, f, settings.cycle);
+        relative_residual = std::sqrt(multigrid.residualNorm2(I, f)) / scale;
+        if (settings.progress)
+            settings.progress({ cycles + 1, relative_residual });
+    }
+    if (report)
+        *report = { cycles, relative_residual };
+    return I;
+}
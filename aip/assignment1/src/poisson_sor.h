@@ -0,0 +1,73 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <numbers>
+
+#include "helpers.h"
+#include "poisson.h"
+
+/*
+ * Red-black successive over-relaxation (SOR) solver of the Poisson problem of poisson.h.
+ *
+ * Each sweep updates the pixels with (x + y) even, then the odd ones, in place (poissonRedBlackSweep): a color only
+ * reads the other one, so both halves are parallel and no second buffer is needed, unlike the Jacobi iterations of
+ * solvePoisson. With the optimal factor
+ *   omega = 2 / (1 + sqrt(1 - rho^2)),  rho = (cos(pi / (w + 1)) + cos(pi / (h + 1))) / 2
+ * (rho is the spectral radius of the Jacobi iteration for this grid and boundary) the error shrinks by about
+ * 1 - 2 pi / max(w, h) per sweep instead of 1 - pi^2 / (2 max(w, h)^2), so O(max(w, h)) sweeps replace
+ * O(max(w, h)^2) Jacobi ones.
+ */
+
+/**
+ * The solve also stops when the residual did not decrease over this many sweeps (a multiple of the check
+ * interval). With omega close to 2 the rounding noise of each sweep only decays by omega - 1 per sweep, which
+ * floors the float residual at ~1e-5 relative; the error is converged by then.
+ */
+constexpr int POISSON_SOR_STALL_SWEEPS = 100;
+
+/** Optimal SOR factor for a width x height grid with the zero boundary of poisson.h. */
+inline float poissonOptimalOmega(const int width, const int height)
+{
+    const double rho = 0.5 * (std::cos(std::numbers::pi / (width + 1)) + std::cos(std::numbers::pi / (height + 1)));
+    return float(2.0 / (1.0 + std::sqrt(1.0 - rho * rho)));
+}
+
+/// <summary>
+/// Solves lap I = div G with red-black SOR sweeps, starting from initial_solution.
+/// </summary>
+/// <param name="settings">relative residual tolerance, maximum number of sweeps and omega (0 = optimal)</param>
+/// <param name="pool">optional pool providing the solution buffer</param>
+/// <param name="report">optional, receives the number of sweeps and the final relative residual</param>
+ImageFloat solvePoissonSor(const ImageFloatView initial_solution, const ImageFloatView divergence_G, const PoissonSettings& settings, ImagePool* pool = nullptr, PoissonReport* report = nullptr)
+{
+    const ImageFloatView f = poissonRightHandSide(divergence_G);
+    assert(f.width == initial_solution.width && f.height == initial_solution.height);
+    assert(settings.omega >= 0.0f && settings.omega < 2.0f);
+    const float omega = settings.omega > 0.0f ? settings.omega : poissonOptimalOmega(f.width, f.height);
+
+    auto I = pool ? pool->acquire<float>(f.width, f.height, ImageInit::Uninitialized) : ImageFloat(f.width, f.height, {}, ImageInit::Uninitialized);
+    I.view().copyFrom(initial_solution);
+
+    const double scale = poissonResidualScale(f);
+    double relative_residual = std::sqrt(poissonResidualNorm2(I, f)) / scale;
+    double stall_reference = relative_residual;
+    int sweeps = 0;
+    while (sweeps < settings.max_iterations && relative_residual > settings.tolerance) {
+        const int count = std::min(POISSON_CHECK_INTERVAL, settings.max_iterations - sweeps);
+        for (int i = 0; i < count; i++)
+            poissonRedBlackSweep(I, f, omega);
+        sweeps += count;
+        relative_residual = std::sqrt(poissonResidualNorm2(I, f)) / scale;
+        if (settings.progress)
+            settings.progress({ sweeps, relative_residual });
+        if (sweeps % POISSON_SOR_STALL_SWEEPS == 0) {
+            if (relative_residual >= stall_reference)
+                break;
+            stall_reference = relative_residual;
+        }
+    }
+    if (report)
+        *report = { sweeps, relative_residual };
+    return I;
+}
@@ -12,21 +12,37 @@
 #include "glm/ext/scalar_constants.hpp"
 #include "glm/geometric.hpp"
 #include "helpers.h"
+#include "bilateral_fixed.h"
+#include "bilateral_grid.h"
+#include "bilateral_lut.h"
+#include "bilateral_simd.h"
+#include "bilateral_upsampling.h"
+#include "domain_transform.h"
+#include "fast_bilateral.h"
+#include "guided_filter.h"
+#include "permutohedral.h"
+#include "poisson.h"
+#include "poisson_cg.h"
+#include "poisson_dst.h"
+#include "poisson_masked.h"
+#include "poisson_multigrid.h"
+#include "poisson_sor.h"
 
 /*
  * Utility functions.
  */
 
-template<typename T>
-int getImageOffset(const Image<T>& image, int x, int y)
+/// Works for Image<T> as well as for (mutable) image views.
+template<typename ImageT>
+int getImageOffset(const ImageT& image, int x, int y)
 {
-    return y * image.width + x;
+    return y * image.stride + x;
 }
 
 
 #pragma region HDR TMO
 
-glm::vec2 getRGBImageMinMax(const ImageRGB& image) {
+glm::vec2 getRGBImageMinMax(const ImageRGBView image) {
 
     auto min_val = 1e9f;
     auto max_val = -1e9f;
@@ -56,33 +72,43 @@ glm::vec2 getRGBImageMinMax(const ImageRGB& image) {
 }
 
 
-ImageRGB normalizeRGBImage(const ImageRGB& image)
+ImageRGB normalizeRGBImage(const ImageRGBView image)
 {
     // Create an empty image of the same size as input.
-    auto result = ImageRGB(image.width, image.height);
+    auto result = ImageRGB(image.width, image.height, {}, ImageInit::Uninitialized);
 
     // Find min and max values.
     glm::vec2 min_max = getRGBImageMinMax(image);
 
     // Fill the result with normalized image values (ie, fit the image to [0,1] range).    
-    float x = 1e9f;
     # pragma omp parallel for
-    for (int i = 0; i < image.width * image.height; i++)
-        for (int c = 0; c < 3; c++) 
-            result.data[i][c] = (image.data[i][c] - min_max[0]) / (min_max[1] - min_max[0]);
+    for (int y = 0; y < image.height; y++)
+        for (int x = 0; x < image.width; x++)
+            for (int c = 0; c < 3; c++) 
+                result.row(y)[x][c] = (image.row(y)[x][c] - min_max[0]) / (min_max[1] - min_max[0]);
     
     return result;
 }
 
-ImageRGB applyGamma(const ImageRGB& image, const float gamma)
+/// <summary>
+/// Lazy variant of applyGamma() for expressions, fused into the evaluation of the whole expression.
+/// </summary>
+template <typename E>
+auto applyGamma(const ImageExpr<E>& expr, const float gamma)
+{
+    return lazyPow(expr.derived(), gamma);
+}
+
+ImageRGB applyGamma(const ImageRGBView image, const float gamma)
 {
     // Create an empty image of the same size as input.
-    auto result = ImageRGB(image.width, image.height);
+    auto result = ImageRGB(image.width, image.height, {}, ImageInit::Uninitialized);
 
     // Fill the result with gamma mapped pixel values (result = image^gamma).    
-    for (int i = 0; i < image.width * image.height; i++)
-        for (int c = 0; c < 3; c++)
-            result.data[i][c] = glm::pow(image.data[i][c], gamma);
+    for (int y = 0; y < image.height; y++)
+        for (int x = 0; x < image.width; x++)
+            for (int c = 0; c < 3; c++)
+                result.row(y)[x][c] = glm::pow(image.row(y)[x][c], gamma);
 
     return result;
 }
@@ -96,18 +122,19 @@ ImageRGB applyGamma(const ImageRGB& image, const float gamma)
 /// </summary>
 /// <param name="rgb">A linear RGB image</param>
 /// <returns>log-luminance</returns>
-ImageFloat rgbToLuminance(const ImageRGB& rgb)
+ImageFloat rgbToLuminance(const ImageRGBView rgb)
 {
     // RGB to luminance weights defined in ITU R-REC-BT.601 in the R,G,B order.
     const auto WEIGHTS_RGB_TO_LUM = glm::vec3(0.299f, 0.587f, 0.114f);
     // An empty luminance image.
-    auto luminance = ImageFloat(rgb.width, rgb.height);
+    auto luminance = ImageFloat(rgb.width, rgb.height, {}, ImageInit::Uninitialized);
     // Fill the image by logarithmic luminace.
     // Luminance is a linear combination of the red, green and blue channels using the weights above.
 
     # pragma omp parallel for
-    for (int i = 0; i < rgb.size(); i++)
-        luminance.data[i] = glm::dot(rgb.data[i], WEIGHTS_RGB_TO_LUM);
+    for (int y = 0; y < rgb.height; y++)
+        for (int x = 0; x < rgb.width; x++)
+            luminance.row(y)[x] = glm::dot(rgb.row(y)[x], WEIGHTS_RGB_TO_LUM);
 
     return luminance;
 }
@@ -127,13 +154,13 @@ double gaussian(float mu, float sigma) {
 /// <param name="space_sigma">spatial sigma value of a gaussian kernel.</param>
 /// <param name="range_sigma">intensity sigma value of a gaussian kernel.</param>
 /// <returns>ImageFloat, the filtered intensity.</returns>
-ImageFloat bilateralFilter(const ImageFloat& H, const int size, const float space_sigma, const float range_sigma)
+ImageFloat bilateralFilter(const ImageFloatView H, const int size, const float space_sigma, const float range_sigma)
 {
     // The filter size is always odd.
     assert(size % 2 == 1);
 
     // Empty output image.
-    Image<float> result = ImageFloat(H.width, H.height);
+    Image<float> result = ImageFloat(H.width, H.height, {}, ImageInit::Uninitialized);
 
     auto kernel = [&](int x, int y) -> float {
         double sum = .0;
@@ -157,6 +184,88 @@ ImageFloat bilateralFilter(const ImageFloat& H, const int size, const float spac
     return result;
 }
 
+/// <summary>
+/// Bilateral filter on a tiled image: same kernel and cropping as above (identical results),
+/// but evaluated tile by tile on a gathered tile+halo buffer, so every tap stays within a small, cache-resident block.
+/// </summary>
+TiledImageFloat bilateralFilter(const TiledImageFloat& H, const int size, const float space_sigma, const float range_sigma)
+{
+    assert(size % 2 == 1);
+
+    TiledImageFloat result(H.width, H.height, H.layout, ImageInit::Uninitialized);
+
+    applyStencil(H, result, size / 2, HaloBorder::Zero, [&](const HaloTile<float>& tile, const int x, const int y) -> float {
+        double sum = .0;
+        double k = .0;
+        const float center = tile.at(x, y);
+
+        const int kx_begin = std::max(0, x - size / 2);
+        for (int ky = std::max(0, y - size / 2); ky < std::min(y + size / 2, H.height); ky++) {
+            const float* taps = tile.ptr(kx_begin, ky);
+            for (int kx = kx_begin; kx < std::min(x + size / 2, H.width); kx++) {
+                const float tap = taps[kx - kx_begin];
+                double w = gaussian(glm::distance(glm::vec2(kx, ky), glm::vec2(x, y)), space_sigma) *
+                           gaussian(center - tap, range_sigma);
+                sum += w * tap;
+                k += w;
+            }
+        }
+
+        return sum / k;
+    });
+
+    return result;
+}
+
+/// <summary>
+/// Bilateral filter implementations with the signature of bilateralFilter(H, size, space_sigma, range_sigma).
+/// </summary>
+enum class BilateralBackend {
+    Reference, // bilateralFilter() above.
+    Tiled, // Same kernel on a Morton-ordered tiled copy of H (identical result).
+    Lut, // Precomputed spatial and range weights, float accumulation (see bilateral_lut.h for the error bound).
+    Grid, // Bilateral grid, cost independent of space_sigma (approximate, see bilateral_grid.h).
+    Permutohedral, // Permutohedral lattice guided by H itself (approximate, see permutohedral.h).
+    Simd, // Exact kernel vectorized with AVX2 / AVX-512 (scalar fallback), float accumulation.
+    PiecewiseLinear, // Durand-Dorsey piecewise-linear filter with FFT convolutions (approximate, see fast_bilateral.h).
+    PiecewiseLinearSubsampled, // Same on an image downsampled by ~space_sigma / 2, upsampled bilinearly.
+    Guided, // Self-guided filter, radius size / 2 and epsilon range_sigma^2 (not a bilateral filter, see guided_filter.h).
+    DomainTransform, // Domain-transform recursive filter guided by H, same sigmas, size unused (see domain_transform.h).
+    Subsampled, // Exact kernel on H downsampled by ~space_sigma / 2, joint bilateral upsampling (see bilateral_upsampling.h).
+    Fixed // Compile-time radius specializations for sizes 7, 11, 19 and 27, runtime-radius kernel otherwise (see bilateral_fixed.h).
+};
+
+ImageFloat bilateralFilter(const ImageFloatView H, const int size, const float space_sigma, const float range_sigma, const BilateralBackend backend)
+{
+    switch (backend) {
+    case BilateralBackend::Tiled:
+        return bilateralFilter(TiledImageFloat(H, { .tile_size = 64, .morton = true }), size, space_sigma, range_sigma).toImage();
+    case BilateralBackend::Lut:
+        return bilateralFilterLut(H, size, space_sigma, range_sigma);
+    case BilateralBackend::Grid:
+        return bilateralFilterGrid(H, size, space_sigma, range_sigma);
+    case BilateralBackend::Permutohedral:
+        return bilateralFilterPermutohedral(H, size, space_sigma, range_sigma);
+    case BilateralBackend::Simd:
+        return bilateralFilterSimd(H, size, space_sigma, range_sigma);
+    case BilateralBackend::PiecewiseLinear:
+        return fastBilateralFilter(H, size, space_sigma, range_sigma);
+    case BilateralBackend::PiecewiseLinearSubsampled:
+        return fastBilateralFilter(H, size, space_sigma, range_sigma, std::clamp(int(space_sigma / 2.0f), 1, 8));
+    case BilateralBackend::Guided:
+        return guidedFilter(H, size / 2, range_sigma * range_sigma);
+    case BilateralBackend::DomainTransform:
+        return domainTransformFilter(H, space_sigma, range_sigma);
+    case BilateralBackend::Subsampled:
+        return bilateralFilterSubsampled(H, size, space_sigma, range_sigma, std::clamp(int(space_sigma / 2.0f), 1, 8));
+    case BilateralBackend::Fixed:
+        return bilateralFilterFixedDispatch(H, size, space_sigma, range_sigma);
+    case BilateralBackend::Reference:
+    default:
+        return bilateralFilter(H, size, space_sigma, range_sigma);
+    }
+}
+
 
 /// <summary>
 /// Reduces contrast of an intensity image decomposed in log space (nautral log => ln) and converts it back to the linear space.
@@ -169,18 +278,9 @@ ImageFloat bilateralFilter(const ImageFloat& H, const int size, const float spac
 /// <returns></returns>
 ImageFloat applyDurandToneMappingOperator(const ImageFloat& base_layer, const ImageFloat& detail_layer, const float base_scale, const float output_gain)
 {
-    // Empty output image.
-    auto result = ImageFloat(base_layer.width, base_layer.height);
-
-    // Scale by base_scale and add detail
-    result = base_layer * base_scale;
-    result += detail_layer;
-    
-    // Convert from log to linear
-    result = logToLinear(result);
-
-    // Multiply by output gain
-    result *= output_gain;
+    // Scale by base_scale and add detail, convert from log to linear and multiply by output gain.
+    // The lazy expression is evaluated in a single fused pass into the only allocated image.
+    ImageFloat result = logToLinear(base_layer * base_scale + detail_layer) * output_gain;
 
     // Return final result as SDR.
     return result;
@@ -195,17 +295,18 @@ ImageFloat applyDurandToneMappingOperator(const ImageFloat& base_layer, const Im
 /// <param name="new_luminance">new (target) luminance</param>
 /// <param name="saturation">saturation correction coefficient</param>
 /// <returns>new RGB image</returns>
-ImageRGB rescaleRgbByLuminance(const ImageRGB& original_rgb, const ImageFloat& original_luminance, const ImageFloat& new_luminance, const float saturation = 0.5f)
+ImageRGB rescaleRgbByLuminance(const ImageRGBView original_rgb, const ImageFloatView original_luminance, const ImageFloatView new_luminance, const float saturation = 0.5f)
 {
     // EPSILON for thresholding the divisior.
     const float EPSILON = 1e-7f;
     // An empty RGB image for the result.
-    auto result = ImageRGB(original_rgb.width, original_rgb.height);
+    auto result = ImageRGB(original_rgb.width, original_rgb.height, {}, ImageInit::Uninitialized);
 
     #pragma omp parallel for
-    for (int i = 0; i < result.size(); i++) 
-        for (int c = 0; c < 3; c++)
-            result[i][c] = glm::clamp(glm::pow(original_rgb[i][c] / std::max(original_luminance[i], EPSILON), saturation) * new_luminance[i], (float).0, (float)1.0);
+    for (int y = 0; y < result.height; y++)
+        for (int x = 0; x < result.width; x++)
+            for (int c = 0; c < 3; c++)
+                result.row(y)[x][c] = glm::clamp(glm::pow(original_rgb.row(y)[x][c] / std::max(original_luminance.row(y)[x], EPSILON), saturation) * new_luminance.row(y)[x], (float).0, (float)1.0);
 
     return result;
 }
@@ -225,18 +326,20 @@ ImageRGB rescaleRgbByLuminance(const ImageRGB& original_rgb, const ImageFloat& o
 /// </summary>
 /// <param name="image">input scalar image</param>
 /// <returns>grad image</returns>
-ImageGradient getGradients(const ImageFloat& image)
+ImageGradient getGradients(const ImageFloatView image)
 {
     // An empty gradient pair (dx, dy).
     auto grad = ImageGradient({ image.width + 1, image.height + 1 }, { image.width + 1, image.height + 1 });
 
     printf("(%d %d)\n", image.width, image.height);
 
-    // Gradient
+    // Gradient (the last column of dX and the last row of dY would read outside the image, see boundaries)
     for (int y = 1; y < grad.dy.height; y++) {
         for (int x = 1; x < grad.dx.width; x++) {
-            grad.dx[y * grad.dx.width + x] = image.at(x, y - 1) - image.at(x - 1, y - 1);
-            grad.dy[y * grad.dy.width + x] = image.at(x - 1, y) - image.at(x - 1, y - 1);
+            if (x < image.width)
+                grad.dx[y * grad.dx.width + x] = image.at(x, y - 1) - image.at(x - 1, y - 1);
+            if (y < image.height)
+                grad.dy[y * grad.dy.width + x] = image.at(x - 1, y) - image.at(x - 1, y - 1);
         }
     }
 
@@ -255,6 +358,39 @@ ImageGradient getGradients(const ImageFloat& image)
     return grad;
 }
 
+/// <summary>
+/// Gradients of a tiled image (same result as above), computed tile by tile with a radius 1 stencil on a zero
+/// border: pixel (x, y) gives dX = I(x, y) - I(x - 1, y) at (x, y + 1) and dY = I(x, y) - I(x, y - 1) at (x + 1, y).
+/// Only the last column of dX and the last row of dY lie outside the image; they are -I of the last pixels.
+/// </summary>
+/// <param name="image">input scalar image</param>
+/// <returns>grad image</returns>
+ImageGradient getGradients(const TiledImageFloat& image)
+{
+    TiledImage<glm::vec2> inner(image.width, image.height, image.layout, ImageInit::Uninitialized);
+    applyStencil(image, inner, 1, HaloBorder::Zero, [](const HaloTile<float>& tile, const int x, const int y) {
+        const float center = tile.at(x, y);
+        return glm::vec2(center - tile.at(x - 1, y), center - tile.at(x, y - 1));
+    });
+
+    auto grad = ImageGradient({ image.width + 1, image.height + 1 }, { image.width + 1, image.height + 1 });
+    #pragma omp parallel for
+    for (int y = 0; y < image.height; y++) {
+        float* dx = grad.dx.row(y + 1);
+        float* dy = grad.dy.row(y) + 1;
+        for (int x = 0; x < image.width; x++) {
+            const glm::vec2 g = inner.at(x, y);
+            dx[x] = g.x;
+            dy[x] = g.y;
+        }
+        dx[image.width] = -image.at(image.width - 1, y); // right
+    }
+    for (int x = 0; x < image.width; x++)
+        grad.dy.row(image.height)[x + 1] = -image.at(x, image.height - 1); // bottom
+
+    return grad;
+}
+
 /// <summary>
 /// Merges two gradient images:
 /// - Use source gradients where source_mask > 0.5
@@ -267,7 +403,7 @@ ImageGradient getGradients(const ImageFloat& image)
 /// <param name="target"></param>
 /// <param name="source_mask"></param>
 /// <returns></returns>
-ImageGradient copySourceGradientsToTarget(const ImageGradient& source, const ImageGradient& target, const ImageFloat& source_mask)
+ImageGradient copySourceGradientsToTarget(const ImageGradient& source, const ImageGradient& target, const ImageFloatView source_mask)
 {   
     // An empty gradient pair (dx, dy).
     ImageGradient result = ImageGradient({ target.dx.width, target.dx.height }, { target.dx.width, target.dx.height });
@@ -338,28 +474,38 @@ ImageFloat getDivergence(ImageGradient& gradients)
 
 
 /// <summary>
-/// Solves poisson equation in form grad^2 I = div G.
+/// Solves poisson equation in form grad^2 I = div G with Jacobi iterations.
+/// Stops after settings.max_iterations sweeps, or earlier once the relative residual is below settings.tolerance
+/// (checked every POISSON_CHECK_INTERVAL sweeps when the tolerance or a progress callback is set).
 /// </summary>
 /// <param name="initial_solution">initial solution</param>
 /// <param name="divergence_G">div G</param>
-/// <param name="num_iters">number of iterations</param>
+/// <param name="settings">tolerance, iteration limit and progress callback</param>
+/// <param name="pool">optional pool providing (and recycling) the solver buffers</param>
+/// <param name="report">optional, receives the iterations used and the final relative residual</param>
 /// <returns>luminance I</returns>
-ImageFloat solvePoisson(const ImageFloat& initial_solution, const ImageFloat& divergence_G, const int num_iters = 2000)
+ImageFloat solvePoissonJacobi(const ImageFloatView initial_solution, const ImageFloatView divergence_G, const PoissonSettings& settings, ImagePool* pool = nullptr, PoissonReport* report = nullptr)
 {
+    const auto width = initial_solution.width;
+    const auto height = initial_solution.height;
+
     // Initial solution guess.
-    auto I = ImageFloat(initial_solution);
+    auto I = pool ? pool->acquire<float>(width, height, ImageInit::Uninitialized) : ImageFloat(width, height, {}, ImageInit::Uninitialized);
+    I.view().copyFrom(initial_solution);
+
+    // Another solution for the alteranting updates (swapped by moving buffers, never copied).
+    auto I_next = pool ? pool->acquire<float>(width, height) : ImageFloat(width, height);
 
-    // Another solution for the alteranting updates.
-    auto I_next = ImageFloat(I.width, I.height);
+    // Residuals are only computed when someone needs them.
+    const ImageFloatView f = poissonRightHandSide(divergence_G);
+    const bool check = settings.tolerance > 0.0f || settings.progress;
+    const double scale = check ? poissonResidualScale(f) : 1.0;
+    double relative_residual = check ? std::sqrt(poissonResidualNorm2(I, f)) / scale : 0.0;
 
     // Iterative solver.
-    for (auto iter = 0; iter < num_iters; iter++)
+    auto iter = 0;
+    while (iter < settings.max_iterations && !(check && relative_residual <= settings.tolerance))
     {
-        if (iter % 500 == 0) {
-            // Print progress info every 500 iteartions.
-            std::cout << "[" << iter << "/" << num_iters << "] Solving Poisson equation..." << std::endl;
-        }
-
         // Compute values of I based following the update rule in the slides.
 
         // Note: Parallelize the code using OpenMP directives.
@@ -370,12 +516,66 @@ ImageFloat solvePoisson(const ImageFloat& initial_solution, const ImageFloat& di
         // Swaps the current and next solution so that the next iteration
         // uses the new solution as input and the previous solution as output.
         std::swap(I, I_next);
+        iter++;
+
+        if (check && (iter % POISSON_CHECK_INTERVAL == 0 || iter == settings.max_iterations)) {
+            relative_residual = std::sqrt(poissonResidualNorm2(I, f)) / scale;
+            if (settings.progress)
+                settings.progress({ iter, relative_residual });
+        }
+    }
+
+    if (pool) {
+        pool->release(std::move(I_next));
+    }
+    if (report) {
+        *report = { iter, check ? relative_residual : std::sqrt(poissonResidualNorm2(I, f)) / poissonResidualScale(f) };
     }
 
     // After the last "swap", I is the latest solution.
     return I;
 }
 
+/// <summary>
+/// Solves poisson equation in form grad^2 I = div G with exactly num_iters Jacobi iterations.
+/// The convergence-driven solvers take a PoissonSettings instead (see below).
+/// </summary>
+/// <param name="initial_solution">initial solution</param>
+/// <param name="divergence_G">div G</param>
+/// <param name="num_iters">number of iterations</param>
+/// <param name="pool">optional pool providing (and recycling) the solver buffers</param>
+/// <returns>luminance I</returns>
+ImageFloat solvePoisson(const ImageFloatView initial_solution, const ImageFloatView divergence_G, const int num_iters = 2000, ImagePool* pool = nullptr)
+{
+    return solvePoissonJacobi(initial_solution, divergence_G, { .method = PoissonMethod::Jacobi, .tolerance = 0.0f, .max_iterations = num_iters }, pool);
+}
+
+/// <summary>
+/// Solves poisson equation in form grad^2 I = div G with the solver selected by settings.method (see poisson.h).
+/// </summary>
+/// <param name="initial_solution">initial solution</param>
+/// <param name="divergence_G">div G</param>
+/// <param name="settings">solver, tolerance, iteration limit and progress callback</param>
+/// <param name="pool">optional pool providing (and recycling) the solver buffers</param>
+/// <param name="report">optional, receives the iterations used and the final relative residual</param>
+/// <returns>luminance I</returns>
+ImageFloat solvePoisson(const ImageFloatView initial_solution, const ImageFloatView divergence_G, const PoissonSettings& settings, ImagePool* pool = nullptr, PoissonReport* report = nullptr)
+{
+    switch (settings.method) {
+    case PoissonMethod::Multigrid:
+        return solvePoissonMultigrid(initial_solution, divergence_G, settings, pool, report);
+    case PoissonMethod::RedBlackSor:
+        return solvePoissonSor(initial_solution, divergence_G, settings, pool, report);
+    case PoissonMethod::ConjugateGradient:
+        return solvePoissonConjugateGradient(initial_solution, divergence_G, settings, pool, report);
+    case PoissonMethod::Direct:
+        return solvePoissonDirect(divergence_G, pool, report);
+    case PoissonMethod::Jacobi:
+    default:
+        return solvePoissonJacobi(initial_solution, divergence_G, settings, pool, report);
+    }
+}
+
 #pragma endregion Poisson editing
 
 // Below are pre-implemented parts of the code.
@@ -417,7 +617,7 @@ ImageXYZ getDivergenceXYZ(ImageXYZGradient& grad_xyz)
 /// <param name="target">target</param>
 /// <param name="source_mask">target</param>
 /// <returns>gradient</returns>
-ImageXYZGradient copySourceGradientsToTargetXYZ(const ImageXYZGradient& source, const ImageXYZGradient& target, const ImageFloat& source_mask)
+ImageXYZGradient copySourceGradientsToTargetXYZ(const ImageXYZGradient& source, const ImageXYZGradient& target, const ImageFloatView source_mask)
 {
     return {
         copySourceGradientsToTarget(source.X, target.X, source_mask),
@@ -431,16 +631,43 @@ ImageXYZGradient copySourceGradientsToTargetXYZ(const ImageXYZGradient& source,
 /// </summary>
 /// <param name="divergence_G">div G</param>
 /// <param name="num_iters">number of iterations</param>
+/// <param name="pool">optional pool, the channels then share the ping-pong buffer</param>
 /// <returns>luminance I</returns>
-ImageXYZ solvePoissonXYZ(const ImageXYZ& targetXYZ, const ImageXYZ& divergenceXYZ_G, const int num_iters = 2000)
+ImageXYZ solvePoissonXYZ(const ImageXYZ& targetXYZ, const ImageXYZ& divergenceXYZ_G, const int num_iters = 2000, ImagePool* pool = nullptr)
+{
+    return {
+        solvePoisson(targetXYZ.X, divergenceXYZ_G.X, num_iters, pool),
+        solvePoisson(targetXYZ.Y, divergenceXYZ_G.Y, num_iters, pool),
+        solvePoisson(targetXYZ.Z, divergenceXYZ_G.Z, num_iters, pool),
+    };
+}
+
+/// <summary>
+/// Solves poisson equation in form grad^2 I = div G for each channel with the solver selected by settings.
+/// </summary>
+ImageXYZ solvePoissonXYZ(const ImageXYZ& targetXYZ, const ImageXYZ& divergenceXYZ_G, const PoissonSettings& settings, ImagePool* pool = nullptr)
 {
     return {
-        solvePoisson(targetXYZ.X, divergenceXYZ_G.X, num_iters),
-        solvePoisson(targetXYZ.Y, divergenceXYZ_G.Y, num_iters),
-        solvePoisson(targetXYZ.Z, divergenceXYZ_G.Z, num_iters),
+        solvePoisson(targetXYZ.X, divergenceXYZ_G.X, settings, pool),
+        solvePoisson(targetXYZ.Y, divergenceXYZ_G.Y, settings, pool),
+        solvePoisson(targetXYZ.Z, divergenceXYZ_G.Z, settings, pool),
     };
 }
 
+/// <summary>
+/// Solves poisson equation in form grad^2 I = div G for each channel on the pixels with source_mask > 0.5 only
+/// (see poisson_masked.h): the other pixels keep the target values, and the cost follows the mask size.
+/// </summary>
+/// <param name="targetXYZ">target, updated in place and returned</param>
+ImageXYZ solvePoissonXYZ(ImageXYZ targetXYZ, const ImageXYZ& divergenceXYZ_G, const ImageFloatView source_mask, const PoissonSettings& settings, ImagePool* pool = nullptr)
+{
+    const PoissonRegion region = poissonRegion(source_mask);
+    solvePoissonMasked(targetXYZ.X, divergenceXYZ_G.X, region, settings, pool);
+    solvePoissonMasked(targetXYZ.Y, divergenceXYZ_G.Y, region, settings, pool);
+    solvePoissonMasked(targetXYZ.Z, divergenceXYZ_G.Z, region, settings, pool);
+    return targetXYZ;
+}
+
 
 #pragma endregion
 
@@ -451,7 +678,7 @@ ImageXYZ solvePoissonXYZ(const ImageXYZ& targetXYZ, const ImageXYZ& divergenceXY
 /// </summary>
 /// <param name="image"></param>
 /// <returns></returns>
-ImageFloat normalizeFloatImage(const ImageFloat& image)
+ImageFloat normalizeFloatImage(const ImageFloatView image)
 {
     return imageRgbToFloat(normalizeRGBImage(imageFloatToRgb(image)));
 }
@@ -174,6 +174,234 @@ TEST_CASE("bilateralFilter")
 
 }
 
+void checkBilateralBackend(const BilateralBackend backend, const int size, const float space_sigma, const float range_sigma, const float tolerance, const std::string& id = "")
+{
+    auto log_lum_H = ImageFloat();
+    log_lum_H.readBinary(rawDataDirPath / ("checkBilateralFilter_" + id + "_log_lum_H.bin"));
+
+    auto reference_output = bilateralFilter(log_lum_H, size, space_sigma, range_sigma);
+    auto user_output = bilateralFilter(log_lum_H, size, space_sigma, range_sigma, backend);
+
+    CHECK(calcImageRMSE(reference_output, user_output) <= tolerance);
+}
+
+TEST_CASE("bilateralFilterBackends")
+{
+    const int filter_size = 9;
+    const float space_sigma = filter_size / 6.4f;
+    const float range_sigma = 0.5f;
+
+    SECTION("Tiled")
+    {
+        checkBilateralBackend(BilateralBackend::Tiled, filter_size, space_sigma, range_sigma, 0.0f, "KitchenImage");
+    }
+
+    SECTION("Lut")
+    {
+        checkBilateralBackend(BilateralBackend::Lut, filter_size, space_sigma, range_sigma, 1e-5f, "KitchenImage");
+    }
+
+    SECTION("Simd")
+    {
+        checkBilateralBackend(BilateralBackend::Simd, filter_size, space_sigma, range_sigma, 1e-5f, "KitchenImage");
+    }
+
+    SECTION("Grid")
+    {
+        checkBilateralBackend(BilateralBackend::Grid, filter_size, space_sigma, range_sigma, 0.05f, "KitchenImage");
+    }
+
+    SECTION("Permutohedral")
+    {
+        checkBilateralBackend(BilateralBackend::Permutohedral, filter_size, space_sigma, range_sigma, 0.05f, "KitchenImage");
+    }
+
+    SECTION("PermutohedralJoint")
+    {
+        // Three value planes guided by an XYZ image of two flat regions: no value crosses the guide edge, a flat
+        // value stays flat, and the overloads agree.
+        const int width = 12, height = 10;
+        const glm::vec3 left = { 0.2f, 0.3f, 0.1f }, right = { 0.8f, 0.5f, 0.9f };
+        auto guide = ImageXYZ { ImageFloat(width, height), ImageFloat(width, height), ImageFloat(width, height) };
+        auto values = ImageFloatPlane3 { ImageFloat(width, height), ImageFloat(width, height), ImageFloat(width, height) };
+        for (int c = 0; c < 3; c++)
+            guide[c].apply([&](const int x, const int) { return x < width / 2 ? left[c] : right[c]; });
+        values.X.apply([&](const int x, const int) { return x < width / 2 ? 1.0f : 3.0f; });
+        values.Y.apply([](const int, const int) { return 0.5f; });
+        values.Z.apply([](const int x, const int y) { return x < width / 2 ? 0.1f * float(y) : -1.0f; });
+
+        const auto filtered = jointBilateralFilterPermutohedral(values, guide, 3.0f, 0.1f);
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                CHECK(filtered.X.at(x, y) == Catch::Approx(x < width / 2 ? 1.0f : 3.0f).margin(1e-3));
+                CHECK(filtered.Y.at(x, y) == Catch::Approx(0.5f).margin(1e-4));
+                if (x >= width / 2)
+                    CHECK(filtered.Z.at(x, y) == Catch::Approx(-1.0f).margin(1e-3));
+            }
+        }
+        // Within the left region Z is smoothed along y only.
+        CHECK(filtered.Z.at(0, 0) > 0.0f);
+        CHECK(filtered.Z.at(0, height - 1) < 0.1f * float(height - 1));
+
+        // Planes are filtered independently with the same weights.
+        const ImageFloatView guide_planes[] = { guide.X, guide.Y, guide.Z };
+        const auto single = jointBilateralFilterPermutohedral(values.Z, guide_planes, 3.0f, 0.1f);
+        CHECK(calcImageRMSE(single, filtered.Z) <= 1e-6f);
+
+        // A flat guide removes the edge: values now mix across it.
+        const auto flat_guide = ImageXYZ { ImageFloat(width, height), ImageFloat(width, height), ImageFloat(width, height) };
+        const auto mixed = jointBilateralFilterPermutohedral(values, flat_guide, 3.0f, 0.1f);
+        CHECK(mixed.X.at(width / 2 - 1, 0) > 1.2f);
+        CHECK(mixed.X.at(width / 2, 0) < 2.8f);
+    }
+
+    SECTION("PiecewiseLinear")
+    {
+        checkBilateralBackend(BilateralBackend::PiecewiseLinear, filter_size, space_sigma, range_sigma, 0.05f, "KitchenImage");
+        checkBilateralBackend(BilateralBackend::PiecewiseLinearSubsampled, filter_size, space_sigma, range_sigma, 0.05f, "KitchenImage");
+
+        // A flat image comes back unchanged (the range has a single level).
+        for (const float value : { 0.5f, -1.25f }) {
+            auto flat = ImageFloat(16, 12);
+            flat.apply([value](const int, const int) { return value; });
+            for (const auto backend : { BilateralBackend::PiecewiseLinear, BilateralBackend::PiecewiseLinearSubsampled }) {
+                const auto output = bilateralFilter(flat, filter_size, space_sigma, range_sigma, backend);
+                CHECK(calcImageRMSE(flat, output) == APPROX_FLOAT(0.0f));
+                CHECK(output.at(7, 5) == value);
+            }
+        }
+    }
+
+    SECTION("DomainTransform")
+    {
+        checkBilateralBackend(BilateralBackend::DomainTransform, filter_size, space_sigma, range_sigma, 0.05f, "KitchenImage");
+    }
+
+    SECTION("Subsampled")
+    {
+        // The backend picks factor 1 (the exact filter) for this sigma; check the upsampling with explicit factors.
+        checkBilateralBackend(BilateralBackend::Subsampled, filter_size, space_sigma, range_sigma, 1e-5f, "KitchenImage");
+
+        auto log_lum_H = ImageFloat();
+        log_lum_H.readBinary(rawDataDirPath / "checkBilateralFilter_KitchenImage_log_lum_H.bin");
+        const int large_size = 27;
+        auto reference_output = bilateralFilter(log_lum_H, large_size, large_size / 6.4f, range_sigma);
+        for (const int factor : { 2, 3 })
+            CHECK(calcImageRMSE(reference_output, bilateralFilterSubsampled(log_lum_H, large_size, large_size / 6.4f, range_sigma, factor)) <= 0.05f);
+    }
+
+    SECTION("Fixed")
+    {
+        // filter_size has no specialization and takes the runtime-radius kernel; check every specialized radius too.
+        checkBilateralBackend(BilateralBackend::Fixed, filter_size, space_sigma, range_sigma, 1e-5f, "KitchenImage");
+
+        auto log_lum_H = ImageFloat();
+        log_lum_H.readBinary(rawDataDirPath / "checkBilateralFilter_KitchenImage_log_lum_H.bin");
+        for (const int radius : BILATERAL_FIXED_RADII) {
+            const int size = 2 * radius + 1;
+            REQUIRE(bilateralFixedRadiusSupported(size));
+            const ImageFloat reference_output = bilateralFilter(log_lum_H, size, size / 6.4f, range_sigma);
+            CHECK(calcImageRMSE(reference_output, bilateralFilterFixedDispatch(log_lum_H, size, size / 6.4f, range_sigma)) <= 1e-5f);
+        }
+    }
+}
+
+/// Largest difference between the blurred unit impulse at (center, center) and the normalized Gaussian, relative
+/// to the Gaussian's peak.
+float gaussianImpulseError(const ImageFloatView output, const int center, const float sigma)
+{
+    const double peak = 1.0 / (2.0 * std::numbers::pi * double(sigma) * sigma);
+    double error = 0.0;
+    for (int y = 0; y < output.height; y++) {
+        for (int x = 0; x < output.width; x++) {
+            const double d2 = double((x - center) * (x - center) + (y - center) * (y - center));
+            error = std::max(error, std::abs(double(output.at(x, y)) - peak * std::exp(-d2 / (2.0 * double(sigma) * sigma))));
+        }
+    }
+    return float(error / peak);
+}
+
+void checkGaussianBlurMethod(const GaussianBlurMethod method, const float sigma, const float tolerance)
+{
+    // The impulse is far enough from the (replicated) border for the Gaussian to vanish there.
+    const int center = int(std::ceil(5.0f * sigma));
+    auto impulse = ImageFloat(2 * center + 1, 2 * center + 1);
+    impulse.row(center)[center] = 1.0f;
+
+    CHECK(gaussianImpulseError(gaussianBlur(impulse, sigma, method), center, sigma) <= tolerance);
+}
+
+TEST_CASE("gaussianBlurMethods")
+{
+    // Tolerances follow framework/gaussian_blur.h: FIR is off by its 3 sigma truncation (renormalized), Deriche is
+    // within about 0.1% and Young-van Vliet within a few percent.
+    SECTION("FIR")
+    {
+        checkGaussianBlurMethod(GaussianBlurMethod::FIR, 4.0f, 0.012f);
+        checkGaussianBlurMethod(GaussianBlurMethod::FIR, 12.0f, 0.012f);
+    }
+
+    SECTION("Deriche")
+    {
+        checkGaussianBlurMethod(GaussianBlurMethod::Deriche, 4.0f, 0.002f);
+        checkGaussianBlurMethod(GaussianBlurMethod::Deriche, 12.0f, 0.002f);
+    }
+
+    SECTION("YoungVanVliet")
+    {
+        checkGaussianBlurMethod(GaussianBlurMethod::YoungVanVliet, 4.0f, 0.06f);
+        checkGaussianBlurMethod(GaussianBlurMethod::YoungVanVliet, 12.0f, 0.06f);
+    }
+
+    SECTION("RGB")
+    {
+        // Channels with different amplitudes blur independently, through the vec3 kernels and the plane overload.
+        const float sigma = 4.0f;
+        const int center = 20;
+        const glm::vec3 amplitude = { 1.0f, 0.5f, 2.0f };
+        auto impulse = ImageRGB(2 * center + 1, 2 * center + 1);
+        impulse.row(center)[center] = amplitude;
+        const auto planes = imageVec3ToPlane3(impulse);
+        for (const auto method : { GaussianBlurMethod::FIR, GaussianBlurMethod::Deriche, GaussianBlurMethod::YoungVanVliet }) {
+            const float tolerance = method == GaussianBlurMethod::Deriche ? 0.002f : (method == GaussianBlurMethod::FIR ? 0.012f : 0.06f);
+            const auto rgb = imageVec3ToPlane3(gaussianBlur(impulse, sigma, method));
+            const auto blurred_planes = gaussianBlur(planes, sigma, method);
+            for (size_t c = 0; c < 3; c++) {
+                auto unit = ImageFloat(rgb[c].width, rgb[c].height);
+                unit.apply([&](const int x, const int y) { return rgb[c].at(x, y) / amplitude[int(c)]; });
+                CHECK(gaussianImpulseError(unit, center, sigma) <= tolerance);
+                CHECK(calcImageRMSE(blurred_planes[c], rgb[c]) <= 1e-6f);
+            }
+        }
+    }
+}
+
+TEST_CASE("guidedFilter")
+{
+    auto log_lum_H = ImageFloat();
+    log_lum_H.readBinary(rawDataDirPath / "checkBilateralFilter_KitchenImage_log_lum_H.bin");
+
+    SECTION("SummedAreaTable")
+    {
+        const SummedAreaTable<float> table(log_lum_H);
+        for (const auto [x, y, radius] : { std::tuple { 0, 0, 3 }, std::tuple { 17, 5, 0 }, std::tuple { 40, 31, 12 }, std::tuple { log_lum_H.width - 1, log_lum_H.height - 2, 7 } }) {
+            double sum = 0.0;
+            int count = 0;
+            for (int ky = std::max(0, y - radius); ky < std::min(y + radius + 1, log_lum_H.height); ky++)
+                for (int kx = std::max(0, x - radius); kx < std::min(x + radius + 1, log_lum_H.width); kx++, count++)
+                    sum += log_lum_H.at(kx, ky);
+            CHECK(table.boxMean(x, y, radius) == Catch::Approx(sum / count).margin(1e-9));
+        }
+    }
+
+    SECTION("Identity")
+    {
+        // With a vanishing epsilon every window keeps the guide as it is.
+        auto user_output = guidedFilter(log_lum_H, 4, 1e-10f);
+        CHECK(calcImageRMSE(log_lum_H, user_output) <= 1e-4f);
+    }
+}
+
 ////////////////////////////////////////////////////
 // 5.applyDurandToneMappingOperator
 ////////////////////////////////////////////////////
@@ -277,6 +505,22 @@ TEST_CASE("getGradients")
     SECTION("4x3Image") {
         checkGetGradients(small_img_4x3, "4x3Image");
     }
+
+    SECTION("Tiled") {
+        // The tiled stencil reproduces the row-major gradients exactly, on cropped border tiles too.
+        for (const auto size : { glm::ivec2(4, 3), glm::ivec2(37, 21) }) {
+            auto image = ImageFloat(size.x, size.y);
+            image.apply([](const int x, const int y) { return std::sin(0.3f * float(x)) + 0.01f * float(x * y) + 1.0f; });
+            const auto reference = getGradients(image);
+            for (const auto layout : { TiledLayout { 8, true }, TiledLayout { 16, false } }) {
+                const auto tiled = getGradients(TiledImageFloat(image, layout));
+                REQUIRE(tiled.dx.width == reference.dx.width);
+                REQUIRE(tiled.dx.height == reference.dx.height);
+                CHECK(tiled.dx.data == reference.dx.data);
+                CHECK(tiled.dy.data == reference.dy.data);
+            }
+        }
+    }
     
 }
 
@@ -406,4 +650,834 @@ TEST_CASE("solvePoisson")
     {
         checkSolvePoisson(small_img_4x3, "4x3Image");
     }
+}
+
+// (w + 2) x (h + 2) divergence whose exact Poisson solution is I (see poisson.h).
+ImageFloat poissonDivergenceOf(const ImageFloat& I)
+{
+    auto divergence = ImageFloat(I.width + 2, I.height + 2);
+    for (int y = 0; y < I.height; y++)
+        for (int x = 0; x < I.width; x++)
+            divergence.row(y + 1)[x + 1] = poissonNeighbourSum(I, x, y) - 4.0f * I.at(x, y);
+    return divergence;
+}
+
+void checkPoissonMethod(const ImageFloat& expected, const PoissonSettings& settings, const float tolerance)
+{
+    const auto divergence = poissonDivergenceOf(expected);
+    const auto emptyImage = ImageFloat(expected.width, expected.height);
+
+    CHECK(calcImageRMSE(expected, solvePoisson(emptyImage, divergence, settings)) <= tolerance);
+}
+
+TEST_CASE("solvePoissonMethods")
+{
+    // Log luminance spans ~10 units; the solvers stop at a relative residual of 1e-6.
+    auto log_lum_H = ImageFloat();
+    log_lum_H.readBinary(rawDataDirPath / "checkBilateralFilter_KitchenImage_log_lum_H.bin");
+    const auto small_luminance = rgbToLuminance(small_img_4x3);
+
+    SECTION("Multigrid")
+    {
+        for (const auto cycle : { MultigridCycle::V, MultigridCycle::F }) {
+            checkPoissonMethod(log_lum_H, { .method = PoissonMethod::Multigrid, .cycle = cycle }, 2e-3f);
+            checkPoissonMethod(small_luminance, { .method = PoissonMethod::Multigrid, .cycle = cycle }, 1e-4f);
+        }
+    }
+
+    SECTION("RedBlackSor")
+    {
+        checkPoissonMethod(log_lum_H, { .method = PoissonMethod::RedBlackSor }, 2e-3f);
+        checkPoissonMethod(small_luminance, { .method = PoissonMethod::RedBlackSor }, 1e-4f);
+        checkPoissonMethod(small_luminance, { .method = PoissonMethod::RedBlackSor, .omega = 1.0f }, 1e-4f);
+
+        // The optimal factor needs far fewer sweeps than Gauss-Seidel (omega = 1).
+        const auto crop = ImageFloat(ImageFloatView(log_lum_H).roi(0, 0, 128, 128));
+        const auto divergence = poissonDivergenceOf(crop);
+        const auto emptyImage = ImageFloat(crop.width, crop.height);
+        PoissonReport optimal, gauss_seidel;
+        solvePoisson(emptyImage, divergence, { .method = PoissonMethod::RedBlackSor, .tolerance = 1e-4f }, nullptr, &optimal);
+        solvePoisson(emptyImage, divergence, { .method = PoissonMethod::RedBlackSor, .tolerance = 1e-4f, .omega = 1.0f }, nullptr, &gauss_seidel);
+        CHECK(optimal.relative_residual <= 1e-4);
+        CHECK(optimal.iterations * 10 < gauss_seidel.iterations);
+    }
+
+    SECTION("ConjugateGradient")
+    {
+        const auto crop = ImageFloat(ImageFloatView(log_lum_H).roi(0, 0, 128, 128));
+        for (const auto preconditioner : { PoissonPreconditioner::Jacobi, PoissonPreconditioner::IncompleteCholesky }) {
+            checkPoissonMethod(crop, { .method = PoissonMethod::ConjugateGradient, .preconditioner = preconditioner }, 1e-3f);
+            checkPoissonMethod(small_luminance, { .method = PoissonMethod::ConjugateGradient, .preconditioner = preconditioner }, 1e-4f);
+        }
+        checkPoissonMethod(log_lum_H, { .method = PoissonMethod::ConjugateGradient, .preconditioner = PoissonPreconditioner::Multigrid }, 2e-3f);
+        checkPoissonMethod(small_luminance, { .method = PoissonMethod::ConjugateGradient, .preconditioner = PoissonPreconditioner::Multigrid }, 1e-4f);
+    }
+
+    SECTION("Direct")
+    {
+        checkPoissonMethod(log_lum_H, { .method = PoissonMethod::Direct }, 2e-3f);
+        checkPoissonMethod(small_luminance, { .method = PoissonMethod::Direct }, 1e-4f);
+
+        // The DST-I is its own inverse up to (n + 1) / 2, for power-of-two and Bluestein sizes alike.
+        for (const int n : { 1, 7, 10 }) {
+            std::vector<float> a(n), b(n);
+            for (int i = 0; i < n; i++)
+                a[i] = b[i] = float(i * i % 5) - 2.0f;
+            std::vector<ComplexF> scratch(DST(n).scratchSize());
+            DST(n).forward(b.data(), nullptr, scratch.data());
+            DST(n).forward(b.data(), nullptr, scratch.data());
+            for (int i = 0; i < n; i++)
+                CHECK(b[i] == APPROX_FLOAT(0.5f * float(n + 1) * a[i]));
+        }
+    }
+
+    SECTION("Masked")
+    {
+        // Solving inside a disk and a strip along the image border, the rest of the exact solution being the
+        // target, recovers the solution there and leaves every other pixel untouched.
+        const auto divergence = poissonDivergenceOf(log_lum_H);
+        auto mask = ImageFloat(log_lum_H.width, log_lum_H.height);
+        const float radius = 0.25f * float(std::min(mask.width, mask.height));
+        mask.apply([&](const int x, const int y) {
+            const bool disk = std::hypot(float(x) - 0.4f * float(mask.width), float(y) - 0.5f * float(mask.height)) < radius;
+            return disk || (x < 3 && y < 20) ? 1.0f : 0.0f;
+        });
+        const PoissonRegion region = poissonRegion(mask);
+        CHECK(region.x == 0);
+        CHECK(region.y == 0);
+
+        for (const auto method : { PoissonMethod::Multigrid, PoissonMethod::RedBlackSor, PoissonMethod::ConjugateGradient }) {
+            auto target = log_lum_H;
+            target.apply([&](const int x, const int y) { return mask.at(x, y) > 0.5f ? 0.0f : target.at(x, y); });
+            PoissonReport report;
+            solvePoissonMasked(target, divergence, region, { .method = method }, nullptr, &report);
+            CHECK(report.relative_residual < 1e-4);
+            CHECK(calcImageRMSE(log_lum_H, target) <= 2e-3f);
+            int changed = 0;
+            for (int y = 0; y < mask.height; y++)
+                for (int x = 0; x < mask.width; x++)
+                    changed += mask.at(x, y) <= 0.5f && target.at(x, y) != log_lum_H.at(x, y);
+            CHECK(changed == 0);
+        }
+
+        // An empty mask is a no-op.
+        auto target = log_lum_H;
+        solvePoissonMasked(target, divergence, poissonRegion(ImageFloat(mask.width, mask.height)), {});
+        CHECK(calcImageRMSE(log_lum_H, target) == 0.0f);
+    }
+
+    SECTION("Progress")
+    {
+        // The callback sees every iteration; the report matches the last call and the iteration cap holds.
+        const auto divergence = poissonDivergenceOf(log_lum_H);
+        const auto emptyImage = ImageFloat(log_lum_H.width, log_lum_H.height);
+        std::vector<PoissonReport> calls;
+        PoissonReport report;
+        const PoissonSettings settings {
+            .method = PoissonMethod::ConjugateGradient,
+            .tolerance = 0.0f,
+            .max_iterations = 5,
+            .progress = [&](const PoissonReport& progress) { calls.push_back(progress); },
+        };
+        solvePoisson(emptyImage, divergence, settings, nullptr, &report);
+        REQUIRE(calls.size() == 5);
+        for (size_t i = 0; i < calls.size(); i++)
+            CHECK(calls[i].iterations == int(i) + 1);
+        CHECK(report.iterations == 5);
+        CHECK(calls.back().relative_residual < 0.01);
+    }
+}
+
+
+////////////////////////////////////////////////////
+// 11.Framework
+////////////////////////////////////////////////////
+TEST_CASE("ImageMove")
+{
+    auto image = ImageFloat(5, 3, ImageLayout::padded());
+    image.row(2)[4] = 7.0f;
+    const int stride = image.stride;
+    const float* pixels = image.data.data();
+    auto checkTaken = [&](const ImageFloat& taken) {
+        CHECK(taken.width == 5);
+        CHECK(taken.height == 3);
+        CHECK(taken.stride == stride);
+        CHECK(taken.data.data() == pixels);
+        CHECK(taken.at(4, 2) == 7.0f);
+        // The moved-from image is empty rather than a 5 x 3 view of no pixels.
+        CHECK(image.width == 0);
+        CHECK(image.height == 0);
+        CHECK(image.stride == 0);
+        CHECK(image.data.empty());
+        CHECK(image.view().size() == 0);
+    };
+
+    SECTION("Construct")
+    {
+        const auto taken = std::move(image);
+        checkTaken(taken);
+    }
+
+    SECTION("Assign")
+    {
+        auto taken = ImageFloat(2, 2);
+        taken = std::move(image);
+        checkTaken(taken);
+    }
+
+    SECTION("Swap")
+    {
+        auto other = ImageFloat(2, 4);
+        swap(image, other);
+        CHECK(other.width == 5);
+        CHECK(other.stride == stride);
+        CHECK(other.data.data() == pixels);
+        CHECK(image.width == 2);
+        CHECK(image.height == 4);
+        CHECK(image.stride == 2);
+        CHECK(image.data.size() == 8);
+    }
+}
+
+TEST_CASE("ImageLayout")
+{
+    SECTION("Strides")
+    {
+        // Padded rows start on a 64-byte cache line: 16 floats, and 16 vec3 (the smallest multiple of 12 bytes
+        // that is one of 64 bytes).
+        CHECK(ImageLayout::padded().strideFor<float>(5) == 16);
+        CHECK(ImageLayout::padded().strideFor<float>(16) == 16);
+        CHECK(ImageLayout::padded().strideFor<float>(17) == 32);
+        CHECK(ImageLayout::padded().strideFor<glm::vec3>(5) == 16);
+        CHECK(ImageLayout::padded().strideFor<glm::vec3>(17) == 32);
+        CHECK(ImageLayout {}.strideFor<glm::vec3>(5) == 5);
+        CHECK(ImageLayout { .min_stride = 10 }.strideFor<float>(5) == 10);
+    }
+
+    SECTION("Access")
+    {
+        auto image = ImageFloat(5, 3, ImageLayout::padded());
+        REQUIRE(image.stride == 16);
+        CHECK_FALSE(image.isPacked());
+        CHECK(image.data.size() == 48);
+        CHECK(image.size() == 15);
+        for (int y = 0; y < image.height; y++) {
+            CHECK(reinterpret_cast<uintptr_t>(image.row(y)) % IMAGE_ALIGNMENT == 0);
+            for (int x = 0; x < image.width; x++)
+                image.row(y)[x] = float(10 * y + x);
+        }
+        for (int y = 0; y < image.height; y++) {
+            for (int x = 0; x < image.width; x++) {
+                CHECK(image.at(x, y) == float(10 * y + x));
+                CHECK(image[size_t(y) * image.width + x] == float(10 * y + x));
+                CHECK(image.view()[size_t(y) * image.width + x] == float(10 * y + x));
+            }
+        }
+
+        const auto packed = ImageFloat(image.view());
+        CHECK(packed.isPacked());
+        CHECK(packed.at(4, 2) == 24.0f);
+    }
+
+    SECTION("Binary")
+    {
+        auto image = ImageRGB(7, 2, ImageLayout::padded());
+        image.apply([](const int x, const int y) { return glm::vec3(float(x), float(y), float(x * y)); });
+        const auto path = std::filesystem::temp_directory_path() / "a1_image_layout.bin";
+        image.saveBinary(path);
+
+        // The file keeps the padded rows; reading honours the layout of the destination.
+        for (const auto layout : { ImageLayout {}, ImageLayout::padded() }) {
+            auto read = ImageRGB(1, 1, layout);
+            read.readBinary(path);
+            REQUIRE(read.width == 7);
+            REQUIRE(read.height == 2);
+            CHECK(read.stride == layout.strideFor<glm::vec3>(7));
+            for (int y = 0; y < read.height; y++)
+                for (int x = 0; x < read.width; x++)
+                    CHECK(read.at(x, y) == image.at(x, y));
+        }
+        std::filesystem::remove(path);
+    }
+}
+
+TEST_CASE("ImageLayoutLoad")
+{
+    // stb decodes into packed rows; the loader copies them into the padded ones.
+    const auto packed = ImageRGB(dataDirPath / "small_rnd_img_4x3.png");
+    const auto padded = ImageRGB(dataDirPath / "small_rnd_img_4x3.png", ImageLayout::padded());
+    REQUIRE(padded.width == packed.width);
+    REQUIRE(padded.height == packed.height);
+    CHECK(padded.stride == ImageLayout::padded().strideFor<glm::vec3>(packed.width));
+    for (int y = 0; y < packed.height; y++)
+        for (int x = 0; x < packed.width; x++)
+            CHECK(padded.at(x, y) == packed.at(x, y));
+}
+TEST_CASE("ImageView")
+{
+    // Writes through offset ROIs of a padded image must stay inside them, padding included.
+    auto image = ImageFloat(20, 9, ImageLayout::padded());
+    REQUIRE(image.stride == 32);
+    std::fill(image.data.begin(), image.data.end(), -1.0f);
+    auto expected = std::vector<float>(image.data.begin(), image.data.end());
+    auto checkPixels = [&]() {
+        int mismatches = 0;
+        for (size_t i = 0; i < expected.size(); i++)
+            mismatches += image.data[i] != expected[i];
+        CHECK(mismatches == 0);
+    };
+    auto expect = [&](const int x, const int y, const float value) { expected[size_t(y) * image.stride + x] = value; };
+
+    SECTION("Fill")
+    {
+        const auto roi = image.roi(3, 2, 7, 5);
+        CHECK(roi.stride == 32);
+        CHECK_FALSE(roi.isPacked());
+        roi.fill(5.0f);
+        for (int y = 2; y < 7; y++)
+            for (int x = 3; x < 10; x++)
+                expect(x, y, 5.0f);
+        checkPixels();
+    }
+
+    SECTION("Apply")
+    {
+        // Nested ROIs add up their offsets; kernel coordinates are relative to the innermost view.
+        const auto inner = image.roi(3, 2, 7, 5).roi(1, 1, 3, 2);
+        CHECK(inner.data == image.row(3) + 4);
+        inner.apply([](const int x, const int y) { return float(100 + 10 * y + x); });
+        for (int y = 0; y < 2; y++)
+            for (int x = 0; x < 3; x++)
+                expect(4 + x, 3 + y, float(100 + 10 * y + x));
+        checkPixels();
+
+        const ImageFloatView read = image.roi(4, 3, 3, 2);
+        for (size_t i = 0; i < read.size(); i++)
+            CHECK(read[i] == float(100 + 10 * (i / 3) + i % 3));
+    }
+
+    SECTION("CopyFrom")
+    {
+        auto src = ImageFloat(9, 6, ImageLayout::padded());
+        src.apply([](const int x, const int y) { return float(x + 10 * y); });
+        // Paste the 7 x 5 block at (1, 1) of src into the bottom-right corner.
+        image.roi(13, 4, 7, 5).copyFrom(src.roi(1, 1, 7, 5));
+        for (int y = 0; y < 5; y++)
+            for (int x = 0; x < 7; x++)
+                expect(13 + x, 4 + y, float(1 + x + 10 * (1 + y)));
+        checkPixels();
+    }
+
+    SECTION("Materialize")
+    {
+        image.apply([](const int x, const int y) { return float(x + 100 * y); });
+        const ImageFloatView roi = image.view().roi(2, 3, 6, 4);
+        for (const auto layout : { ImageLayout {}, ImageLayout::padded() }) {
+            const auto copy = ImageFloat(roi, layout);
+            REQUIRE(copy.width == 6);
+            REQUIRE(copy.height == 4);
+            CHECK(copy.stride == layout.strideFor<float>(6));
+            CHECK(copy.data.data() != image.data.data());
+            for (int y = 0; y < 4; y++)
+                for (int x = 0; x < 6; x++)
+                    CHECK(copy.at(x, y) == float(2 + x + 100 * (3 + y)));
+        }
+    }
+}
+
+TEST_CASE("TileSchedule")
+{
+    // 37 x 23 is not a multiple of the 5 x 3 tiles: the last tile column and row are cropped.
+    const int width = 37, height = 23;
+    const auto policies = { TileSchedule::Policy::Static, TileSchedule::Policy::Dynamic, TileSchedule::Policy::Guided };
+    auto value = [](const int x, const int y) { return float(x + 100 * y); };
+    auto image = ImageFloat(width, height, ImageLayout::padded());
+    std::vector<int> visits;
+    auto reset = [&]() {
+        std::fill(image.data.begin(), image.data.end(), -1.0f);
+        visits.assign(size_t(width) * height, 0);
+    };
+    auto visit = [&](const int x, const int y) {
+        #pragma omp atomic
+        visits[size_t(y) * width + x]++;
+    };
+    auto checkImage = [&]() {
+        int mismatches = 0;
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++)
+                mismatches += visits[size_t(y) * width + x] != 1 || image.at(x, y) != value(x, y);
+            // Row padding is never written.
+            for (int x = width; x < image.stride; x++)
+                mismatches += image.row(y)[x] != -1.0f;
+        }
+        CHECK(mismatches == 0);
+    };
+
+    SECTION("Apply")
+    {
+        for (const auto policy : policies) {
+            reset();
+            image.apply([&](const int x, const int y) {
+                visit(x, y);
+                return value(x, y);
+            }, TileSchedule { 5, 3, policy });
+            checkImage();
+        }
+    }
+
+    SECTION("ApplyTiles")
+    {
+        for (const auto policy : policies) {
+            reset();
+            int bad_tiles = 0;
+            image.applyTiles([&](const MutableImageFloatView tile, const int x0, const int y0) {
+                const bool aligned = x0 % 5 == 0 && y0 % 3 == 0 && tile.data == image.row(y0) + x0;
+                const bool cropped = tile.width == std::min(5, width - x0) && tile.height == std::min(3, height - y0);
+                if (!aligned || !cropped) {
+                    #pragma omp atomic
+                    bad_tiles++;
+                }
+                for (int y = 0; y < tile.height; y++) {
+                    for (int x = 0; x < tile.width; x++) {
+                        visit(x0 + x, y0 + y);
+                        tile.row(y)[x] = value(x0 + x, y0 + y);
+                    }
+                }
+            }, TileSchedule { 5, 3, policy });
+            CHECK(bad_tiles == 0);
+            checkImage();
+        }
+    }
+}
+
+TEST_CASE("ImageExpr")
+{
+    auto base = ImageFloat(6, 5, ImageLayout::padded());
+    auto detail = ImageFloat(6, 5);
+    base.apply([](const int x, const int y) { return 0.25f * float(x) - 0.5f * float(y); });
+    detail.apply([](const int x, const int y) { return 0.1f * float((x * 7 + y * 3) % 5) - 0.2f; });
+
+    SECTION("Fused")
+    {
+        // The fused tone mapping matches the same steps evaluated eagerly, one image per step.
+        const float base_scale = 0.3f, output_gain = 1.7f;
+        const auto fused = applyDurandToneMappingOperator(base, detail, base_scale, output_gain);
+        auto log_image = ImageFloat(base.width, base.height);
+        for (int y = 0; y < base.height; y++)
+            for (int x = 0; x < base.width; x++)
+                log_image.row(y)[x] = base.at(x, y) * base_scale + detail.at(x, y);
+        const auto linear = logToLinear(log_image.view());
+        REQUIRE(fused.width == base.width);
+        REQUIRE(fused.height == base.height);
+        for (int y = 0; y < base.height; y++)
+            for (int x = 0; x < base.width; x++)
+                CHECK(fused.at(x, y) == Catch::Approx(linear.at(x, y) * output_gain).epsilon(1e-6));
+    }
+
+    SECTION("Aliasing")
+    {
+        // Every pixel only reads itself, so an expression may assign to one of its operands, padded or not.
+        for (auto* image : { &base, &detail }) {
+            const auto original = ImageFloat(*image);
+            const float* pixels = image->data.data();
+            *image = *image * 2.0f + 1.0f;
+            CHECK(image->data.data() == pixels);
+            *image += *image * original;
+            for (int y = 0; y < image->height; y++) {
+                for (int x = 0; x < image->width; x++) {
+                    const float scaled = original.at(x, y) * 2.0f + 1.0f;
+                    CHECK(image->at(x, y) == Catch::Approx(scaled + scaled * original.at(x, y)));
+                }
+            }
+        }
+    }
+
+    SECTION("Widening")
+    {
+        // Compact leaves are widened before any arithmetic: half to float, 8-bit to [0,1].
+        auto halves = Image<half>(4, 3);
+        halves.apply([](const int x, const int y) { return half(1.0f / 3.0f + float(x) - 2.0f * float(y)); });
+        const ImageFloat from_half = halves * 2.0f + base.view().roi(0, 0, 4, 3);
+        auto bytes = Image<uint8_t>(4, 3);
+        bytes.apply([](const int x, const int y) { return uint8_t(x * 80 + y); });
+        const ImageFloat from_bytes = bytes - 1.0f;
+        for (int y = 0; y < 3; y++) {
+            for (int x = 0; x < 4; x++) {
+                CHECK(from_half.at(x, y) == float(halves.at(x, y)) * 2.0f + base.at(x, y));
+                CHECK(from_bytes.at(x, y) == float(x * 80 + y) / 255.0f - 1.0f);
+            }
+        }
+
+        // Assigning to a compact image narrows once, at the end.
+        auto narrowed = Image<uint8_t>(4, 3);
+        narrowed = bytes * 0.5f;
+        CHECK(narrowed.at(3, 2) == unitFloatToUnorm8(float(242) / 255.0f * 0.5f));
+    }
+}
+TEST_CASE("ImagePool")
+{
+    ImagePool pool;
+    const auto layout = ImageLayout::padded();
+    const size_t bytes = size_t(layout.strideFor<float>(5)) * 3 * sizeof(float);
+
+    SECTION("Reuse")
+    {
+        auto image = pool.acquire<float>(5, 3, ImageInit::Uninitialized, layout);
+        const float* pixels = image.data.data();
+        pool.release(std::move(image));
+        CHECK(image.data.empty());
+        CHECK(pool.bytesCached() == bytes);
+
+        // Same element type and count: the released buffer comes back. Another type never shares it.
+        const auto other = pool.acquire<int>(16, 3, ImageInit::Uninitialized);
+        CHECK(pool.numReused() == 0);
+        const auto reused = pool.acquire<float>(5, 3, ImageInit::Uninitialized, layout);
+        CHECK(reused.data.data() == pixels);
+        CHECK(reused.stride == 16);
+        CHECK(pool.numAllocated() == 2);
+        CHECK(pool.numReused() == 1);
+        CHECK(pool.bytesCached() == 0);
+    }
+
+    SECTION("Zero")
+    {
+        auto image = pool.acquire<float>(5, 3, ImageInit::Uninitialized, layout);
+        std::fill(image.data.begin(), image.data.end(), 5.0f);
+        pool.release(std::move(image));
+
+        const auto zeroed = pool.acquire<float>(5, 3, ImageInit::Zero, layout);
+        REQUIRE(pool.numReused() == 1);
+        for (int y = 0; y < zeroed.height; y++)
+            for (int x = 0; x < zeroed.width; x++)
+                CHECK(zeroed.at(x, y) == 0.0f);
+    }
+
+    SECTION("Peak")
+    {
+        auto a = pool.acquire<float>(5, 3, ImageInit::Uninitialized, layout);
+        auto b = pool.acquire<float>(5, 3, ImageInit::Uninitialized, layout);
+        CHECK(pool.bytesInUse() == 2 * bytes);
+        pool.release(std::move(a));
+        CHECK(pool.bytesInUse() == bytes);
+        auto c = pool.acquire<float>(5, 3, ImageInit::Uninitialized, layout);
+        pool.release(std::move(b));
+        pool.release(std::move(c));
+        CHECK(pool.bytesInUse() == 0);
+        CHECK(pool.peakBytesInUse() == 2 * bytes);
+
+        // Adopted buffers are cached but were never in use.
+        pool.adopt(ImageFloat(7, 7));
+        CHECK(pool.bytesInUse() == 0);
+        CHECK(pool.bytesCached() == 2 * bytes + 49 * sizeof(float));
+        pool.clear();
+        CHECK(pool.bytesCached() == 0);
+        CHECK(pool.peakBytesInUse() == 2 * bytes);
+    }
+}
+
+TEST_CASE("HelpersPadded")
+{
+    // The conversions read padded inputs row by row into packed outputs.
+    const auto layout = ImageLayout::padded();
+    auto plane = [&](const float offset) {
+        auto image = ImageFloat(5, 3, layout);
+        image.apply([offset](const int x, const int y) { return offset + float(x) - 0.5f * float(y); });
+        return image;
+    };
+    const auto planes = ImageFloatPlane3 { plane(0.0f), plane(1.0f), plane(-2.0f) };
+    const auto gradient = ImageGradient { plane(0.0f), plane(-3.0f) };
+
+    const auto vec3 = imagePlane3ToVec3(planes);
+    const auto grad_rgb = gradientsToRgb(gradient);
+    const auto rgb = xyzToRGB(planes);
+    const auto xyz = rgbToXYZ(rgb);
+    REQUIRE(vec3.isPacked());
+    REQUIRE(grad_rgb.isPacked());
+    REQUIRE(rgb.isPacked());
+    for (int y = 0; y < 3; y++) {
+        for (int x = 0; x < 5; x++) {
+            CHECK(vec3.at(x, y) == glm::vec3(planes.X.at(x, y), planes.Y.at(x, y), planes.Z.at(x, y)));
+            CHECK(grad_rgb.at(x, y) == glm::abs(glm::vec3(gradient.dx.at(x, y), gradient.dy.at(x, y), 0.0f)));
+            CHECK(xyz.X.at(x, y) == Catch::Approx(planes.X.at(x, y)).margin(1e-4));
+            CHECK(xyz.Y.at(x, y) == Catch::Approx(planes.Y.at(x, y)).margin(1e-4));
+            CHECK(xyz.Z.at(x, y) == Catch::Approx(planes.Z.at(x, y)).margin(1e-4));
+        }
+    }
+}
+TEST_CASE("ImageFile")
+{
+    const auto path = std::filesystem::temp_directory_path() / "a1_image_file.bin";
+    auto plane = [](const float offset) {
+        auto image = ImageFloat(5, 3, ImageLayout::padded());
+        image.apply([offset](const int x, const int y) { return offset + float(x) + 0.25f * float(y); });
+        return image;
+    };
+    const std::vector<ImageFloat> images = { plane(0.0f), plane(10.0f), plane(-10.0f) };
+    const std::vector<ImageView<float>> views = { images[0].view(), images[1].view(), images[2].view() };
+    auto checkEqual = [](const ImageView<float>& a, const ImageView<float>& b) {
+        REQUIRE(a.width == b.width);
+        REQUIRE(a.height == b.height);
+        for (int y = 0; y < a.height; y++)
+            for (int x = 0; x < a.width; x++)
+                CHECK(a.at(x, y) == b.at(x, y));
+    };
+
+    SECTION("Planes")
+    {
+        for (const size_t num_planes : { size_t(1), size_t(3) }) {
+            writeImageFile<float>(path, std::span(views).first(num_planes));
+            std::ifstream file(path, std::ios::binary);
+            const auto header = readImageFileHeader(file);
+            REQUIRE(header.isValid());
+            CHECK(header.num_planes == num_planes);
+            CHECK(header.stride == 16);
+            CHECK(header.plane_bytes == 192);
+            CHECK(std::filesystem::file_size(path) == header.planeOffset(header.num_planes));
+
+            const auto read = readImageFilePlanes<float>(path);
+            REQUIRE(read.size() == num_planes);
+            for (size_t p = 0; p < num_planes; p++) {
+                CHECK(read[p].isPacked());
+                checkEqual(read[p], images[p]);
+            }
+        }
+    }
+
+    SECTION("Mapped")
+    {
+        writeImageFile<float>(path, std::span(views));
+        {
+            const MappedImageFile mapped(path);
+            for (uint32_t p = 0; p < 3; p++) {
+                const auto view = mapped.plane<float>(p);
+                CHECK(view.stride == 16);
+                CHECK(reinterpret_cast<uintptr_t>(view.row(0)) % IMAGE_ALIGNMENT == 0);
+                checkEqual(view, images[p]);
+            }
+            CHECK_THROWS(mapped.plane<float>(3));
+            CHECK_THROWS(mapped.plane<glm::vec3>(0));
+        }
+    }
+
+    SECTION("Legacy")
+    {
+        // Raw width, height and packed pixels, read into a padded image.
+        {
+            std::ofstream file(path, std::ios::binary);
+            const int32_t size[] = { 5, 3 };
+            file.write(reinterpret_cast<const char*>(size), sizeof(size));
+            for (int y = 0; y < 3; y++)
+                file.write(reinterpret_cast<const char*>(images[1].row(y)), 5 * sizeof(float));
+        }
+        auto read = ImageFloat(1, 1, ImageLayout::padded());
+        read.readBinary(path);
+        CHECK(read.stride == 16);
+        checkEqual(read, images[1]);
+    }
+
+    SECTION("Gradient")
+    {
+        const auto gradient = ImageGradient { images[1], images[2] };
+        gradient.saveBinary(path);
+        std::ifstream file(path, std::ios::binary);
+        CHECK(readImageFileHeader(file).num_planes == 2);
+        file.close();
+
+        ImageGradient read;
+        read.readBinary(path);
+        checkEqual(read.dx, gradient.dx);
+        checkEqual(read.dy, gradient.dy);
+    }
+
+    SECTION("Corrupt")
+    {
+        // A file with the magic but inconsistent fields is rejected instead of being trusted.
+        auto writeCorrupt = [&](auto&& corrupt) {
+            writeImageFile<float>(path, std::span(views));
+            std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+            auto header = readImageFileHeader(file);
+            corrupt(header);
+            file.seekp(0);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        };
+        const std::vector<std::function<void(ImageFileHeader&)>> corruptions = {
+            [](ImageFileHeader& header) { header.header_size = 16; },
+            [](ImageFileHeader& header) { header.alignment = 0; },
+            [](ImageFileHeader& header) { header.alignment = 48; },
+            [](ImageFileHeader& header) { header.width = 0; },
+            [](ImageFileHeader& header) { header.height = -3; },
+            [](ImageFileHeader& header) { header.stride = 4; },
+            [](ImageFileHeader& header) { header.plane_bytes = 64; },
+            [](ImageFileHeader& header) { header.element_size = 2; },
+            [](ImageFileHeader& header) { header.element_type = ImageElementType::Unknown; },
+            [](ImageFileHeader& header) { header.num_planes = 0; },
+            // A newer format version is refused rather than misread as version 1.
+            [](ImageFileHeader& header) { header.version = ImageFileHeader::VERSION + 1; },
+            [](ImageFileHeader& header) { header.version = 0; },
+        };
+        for (const auto& corrupt : corruptions) {
+            writeCorrupt(corrupt);
+            auto read = ImageFloat(1, 1);
+            CHECK_THROWS(read.readBinary(path));
+            CHECK_THROWS(readImageFilePlanes<float>(path));
+            CHECK_THROWS(MappedImageFile(path));
+        }
+
+        // Planes missing from the end of the file.
+        writeImageFile<float>(path, std::span(views));
+        std::filesystem::resize_file(path, std::filesystem::file_size(path) - 192);
+        CHECK_THROWS(readImageFilePlanes<float>(path));
+        CHECK_THROWS(MappedImageFile(path));
+    }
+    std::filesystem::remove(path);
+}
+TEST_CASE("PixelTypes")
+{
+    SECTION("Half")
+    {
+        CHECK(floatToHalfBits(1.0f) == 0x3c00);
+        CHECK(floatToHalfBits(-2.0f) == 0xc000);
+        CHECK(floatToHalfBits(-0.0f) == 0x8000);
+        // Ties round to even, anything above a tie rounds up.
+        CHECK(floatToHalfBits(1.0f + 0x1p-11f) == 0x3c00);
+        CHECK(floatToHalfBits(1.0f + 3 * 0x1p-11f) == 0x3c02);
+        CHECK(floatToHalfBits(1.0f + 0x1p-11f + 0x1p-20f) == 0x3c01);
+        // Subnormals, and 2^-25 (half of the smallest subnormal) as the boundary to zero.
+        CHECK(floatToHalfBits(0x1p-14f) == 0x0400);
+        CHECK(floatToHalfBits(0x1p-14f - 0x1p-24f) == 0x03ff);
+        CHECK(floatToHalfBits(0x1p-24f) == 0x0001);
+        CHECK(floatToHalfBits(3 * 0x1p-25f) == 0x0002);
+        CHECK(floatToHalfBits(0x1p-25f) == 0x0000);
+        CHECK(floatToHalfBits(std::nextafter(0x1p-25f, 1.0f)) == 0x0001);
+        CHECK(floatToHalfBits(-0x1p-26f) == 0x8000);
+        // 65504 is the largest half; 65520 is the tie with the next power of two and overflows.
+        CHECK(floatToHalfBits(65504.0f) == 0x7bff);
+        CHECK(floatToHalfBits(std::nextafter(65520.0f, 0.0f)) == 0x7bff);
+        CHECK(floatToHalfBits(65520.0f) == 0x7c00);
+        CHECK(floatToHalfBits(-1e10f) == 0xfc00);
+        CHECK(floatToHalfBits(std::numeric_limits<float>::infinity()) == 0x7c00);
+        CHECK(floatToHalfBits(-std::numeric_limits<float>::infinity()) == 0xfc00);
+        const uint16_t nan = floatToHalfBits(std::numeric_limits<float>::quiet_NaN());
+        CHECK((nan & 0x7c00) == 0x7c00);
+        CHECK((nan & 0x3ff) != 0);
+
+        CHECK(halfBitsToFloat(0x0001) == 0x1p-24f);
+        CHECK(halfBitsToFloat(0x7bff) == 65504.0f);
+        CHECK(halfBitsToFloat(0x3555) == 0.333251953125f);
+        CHECK(halfBitsToFloat(0xfc00) == -std::numeric_limits<float>::infinity());
+        CHECK(std::isnan(halfBitsToFloat(0x7e00)));
+
+        // Every half is exactly representable as a float and comes back unchanged.
+        int mismatches = 0;
+        for (uint32_t bits = 0; bits <= 0xffff; bits++) {
+            const float value = halfBitsToFloat(uint16_t(bits));
+            const bool is_nan = (bits & 0x7c00) == 0x7c00 && (bits & 0x3ff) != 0;
+            if (is_nan ? !std::isnan(value) : floatToHalfBits(value) != bits)
+                mismatches++;
+        }
+        CHECK(mismatches == 0);
+    }
+
+    SECTION("Unorm8")
+    {
+        int mismatches = 0;
+        for (int v = 0; v < 256; v++) {
+            const auto value = uint8_t(v);
+            if (PixelTraits<uint8_t>::fromCompute(PixelTraits<uint8_t>::toCompute(value)) != value)
+                mismatches++;
+            const auto rgb = glm::u8vec3(value, uint8_t(255 - v), uint8_t(v / 2));
+            if (PixelTraits<glm::u8vec3>::fromCompute(PixelTraits<glm::u8vec3>::toCompute(rgb)) != rgb)
+                mismatches++;
+        }
+        CHECK(mismatches == 0);
+
+        CHECK(unitFloatToUnorm8(0.5f) == 128);
+        CHECK(unitFloatToUnorm8(-1.0f) == 0);
+        CHECK(unitFloatToUnorm8(2.0f) == 255);
+        CHECK(unitFloatToUnorm8(std::numeric_limits<float>::infinity()) == 255);
+        CHECK(unitFloatToUnorm8(std::numeric_limits<float>::quiet_NaN()) == 0);
+        CHECK(unitFloatToUnorm8(-std::numeric_limits<float>::quiet_NaN()) == 0);
+    }
+
+    SECTION("Rgb8")
+    {
+        // Writing truncates, clamps and maps NaN (e.g. 0 / 0 of a flat normalized image) to 0.
+        const float row[] = { std::numeric_limits<float>::quiet_NaN(), -1.0f, 0.5f, 2.0f };
+        stbi_uc rgb[12];
+        typeRowToRgbUint8<float>(row, 4, 1.0f, nullptr, rgb);
+        const stbi_uc expected[] = { 0, 0, 127, 255 };
+        for (int i = 0; i < 12; i++)
+            CHECK(rgb[i] == expected[i / 3]);
+    }
+}
+TEST_CASE("TiledImage")
+{
+    auto pixel = [](const int x, const int y) { return 1.0f + float(x) + 100.0f * float(y); };
+
+    SECTION("RoundTrip")
+    {
+        // Border tiles are only partly covered when the size is not a multiple of the tile.
+        for (const auto size : { glm::ivec2(1, 1), glm::ivec2(16, 16), glm::ivec2(37, 21), glm::ivec2(17, 33) }) {
+            for (const auto layout : { TiledLayout { 8, false }, TiledLayout { 16, true } }) {
+                auto image = ImageFloat(size.x, size.y, ImageLayout::padded());
+                image.apply(pixel);
+                const auto tiled = TiledImage<float>(image, layout);
+                CHECK(tiled.tiles_x == (size.x + layout.tile_size - 1) / layout.tile_size);
+                CHECK(tiled.tiles_y == (size.y + layout.tile_size - 1) / layout.tile_size);
+                const auto back = tiled.toImage();
+                REQUIRE(back.width == size.x);
+                REQUIRE(back.height == size.y);
+                int mismatches = 0;
+                for (int y = 0; y < size.y; y++)
+                    for (int x = 0; x < size.x; x++)
+                        mismatches += back.at(x, y) != pixel(x, y) || tiled.at(x, y) != pixel(x, y);
+                CHECK(mismatches == 0);
+            }
+        }
+    }
+
+    SECTION("Morton")
+    {
+        CHECK(mortonCode(3, 5) == 0b100111);
+        // 3 x 5 tiles: the Morton order skips the missing tiles and the storage stays compact.
+        const auto tiled = TiledImage<float>(23, 40, TiledLayout { 8, true });
+        REQUIRE(tiled.tileCount() == 15);
+        CHECK(tiled.data.size() == 15 * tiled.tileElements());
+        const std::vector<glm::ivec2> expected = { { 0, 0 }, { 1, 0 }, { 0, 1 }, { 1, 1 }, { 2, 0 }, { 2, 1 }, { 0, 2 }, { 1, 2 },
+            { 0, 3 }, { 1, 3 }, { 2, 2 }, { 2, 3 }, { 0, 4 }, { 1, 4 }, { 2, 4 } };
+        for (int slot = 0; slot < tiled.tileCount(); slot++) {
+            const auto t = tiled.slotTile(slot);
+            CHECK(t == expected[size_t(slot)]);
+            CHECK(tiled.tileSlot(t.x, t.y) == slot);
+        }
+    }
+
+    SECTION("Halo")
+    {
+        auto image = ImageFloat(10, 7);
+        image.apply(pixel);
+        const auto tiled = TiledImage<float>(image, TiledLayout { 4, true });
+        const int radius = 2;
+        std::vector<float> storage;
+        for (const auto border : { HaloBorder::Zero, HaloBorder::Clamp }) {
+            int mismatches = 0;
+            for (int ty = 0; ty < tiled.tiles_y; ty++) {
+                for (int tx = 0; tx < tiled.tiles_x; tx++) {
+                    const auto halo = gatherHaloTile(tiled, tx, ty, radius, border, storage);
+                    CHECK(halo.width == std::min(4, 10 - 4 * tx));
+                    CHECK(halo.height == std::min(4, 7 - 4 * ty));
+                    for (int y = halo.y0 - radius; y < halo.y0 + halo.height + radius; y++) {
+                        for (int x = halo.x0 - radius; x < halo.x0 + halo.width + radius; x++) {
+                            const bool inside = x >= 0 && y >= 0 && x < 10 && y < 7;
+                            float expected = pixel(std::clamp(x, 0, 9), std::clamp(y, 0, 6));
+                            if (border == HaloBorder::Zero && !inside)
+                                expected = 0.0f;
+                            mismatches += halo.at(x, y) != expected || *halo.ptr(x, y) != expected;
+                        }
+                    }
+                }
+            }
+            CHECK(mismatches == 0);
+        }
+    }
 }
\ No newline at end of file